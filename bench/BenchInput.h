@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// a program of roughly 'size' bytes made of assignments and expressions like
+// the ones users write, the same for every run so numbers can be compared
+inline std::string generate_program(size_t size)
+{
+	static const char* NAMES[] = { "x", "count", "total_sum", "a1", "_tmp", "velocity", "i", "result" };
+	static const char* OPS[] = { " + ", " - ", " * ", " / ", " < ", " >= ", " == ", " && ", " || " };
+
+	std::string text;
+	text.reserve(size + 128);
+
+	uint32_t state = 12345;
+	auto next = [&state]() { state = state * 1103515245 + 12345; return (state >> 16) & 0x7fff; };
+
+	while (text.size() < size)
+	{
+		text += NAMES[next() % 8];
+		text += " = ";
+
+		int terms = 1 + next() % 4;
+		for (int t = 0; t < terms; t++)
+		{
+			if (t) text += OPS[next() % 9];
+
+			switch (next() % 4)
+			{
+			case 0: text += NAMES[next() % 8]; break;
+			case 1: text += std::to_string(next()); break;
+			case 2: text += std::to_string(next() % 100) + "." + std::to_string(next() % 10); break;
+			default: text += "(" + std::string(NAMES[next() % 8]) + " * 2)"; break;
+			}
+		}
+
+		text += ";\n";
+	}
+
+	return text;
+}
+
+// best wall time of 'runs' calls of 'f', in seconds
+template<typename F>
+double best_of(int runs, F&& f)
+{
+	double best = 1e30;
+	for (int i = 0; i < runs; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		f();
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		if (seconds < best) best = seconds;
+	}
+	return best;
+}
@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "BenchInput.h"
+#include "CharClass.h"
+#include "Lexer.h"
+
+// lexer throughput in MB/s. The character classification is measured both the
+// way the lexer did it before CharClass.h (a search of a LETTERS string and a
+// switch per byte) and with the table and SIMD runs it uses now, over the same
+// identifier, number and whitespace runs the lexer scans. Usage:
+//   lexer_bench [megabytes]
+
+static const std::string LETTERS = "_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+static bool old_is_letter(char c) { return LETTERS.find(c) != std::string::npos; }
+
+static bool old_is_digit(char c)
+{
+	switch (c)
+	{
+	case '0': case '1': case '2': case '3': case '4':
+	case '5': case '6': case '7': case '8': case '9':
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool old_is_space(char c)
+{
+	switch (c)
+	{
+	case ' ': case '\t': case '\r': case '\n':
+		return true;
+	default:
+		return false;
+	}
+}
+
+// both return how many bytes were in runs, so the work can't be optimized away
+static size_t classify_before(const std::string& text)
+{
+	size_t in_runs = 0;
+	size_t i = 0;
+	while (i < text.size())
+	{
+		size_t start = i;
+		if (old_is_letter(text[i])) while (i < text.size() && old_is_letter(text[i])) i++;
+		else if (old_is_digit(text[i])) while (i < text.size() && old_is_digit(text[i])) i++;
+		else if (old_is_space(text[i])) while (i < text.size() && old_is_space(text[i])) i++;
+		else i++;
+		in_runs += i - start;
+	}
+	return in_runs;
+}
+
+static size_t classify_after(const std::string& text)
+{
+	size_t in_runs = 0;
+	size_t i = 0;
+	while (i < text.size())
+	{
+		size_t start = i;
+		const char* p = text.data() + i;
+		size_t left = text.size() - i;
+
+		if (Chronos::is_letter(*p)) i += Chronos::scan_letters(p, left);
+		else if (Chronos::is_digit(*p)) i += Chronos::scan_digits(p, left);
+		else if (Chronos::is_space(*p)) i += Chronos::scan_spaces(p, left);
+		else i++;
+		in_runs += i - start;
+	}
+	return in_runs;
+}
+
+int main(int argc, char** argv)
+{
+	size_t megabytes = argc > 1 ? (size_t) atoi(argv[1]) : 32;
+	std::string text = generate_program(megabytes << 20);
+	double mb = text.size() / (1024.0 * 1024.0);
+
+	size_t before_runs = 0, after_runs = 0, tokens = 0;
+	double before = best_of(5, [&] { before_runs = classify_before(text); });
+	double after = best_of(5, [&] { after_runs = classify_after(text); });
+
+	double lex = best_of(5, [&]
+	{
+		Chronos::StringTable strings;
+		Chronos::Lexer lexer(strings);
+		lexer.load_text(text.data(), text.size());
+		lexer.parse_tokens();
+		tokens = lexer.get_tokens().size();
+	});
+
+#if defined(CHRONOS_AVX2)
+	const char* simd = "AVX2";
+#elif defined(CHRONOS_SSE2)
+	const char* simd = "SSE2";
+#else
+	const char* simd = "none";
+#endif
+
+	printf("input: %.1f MB, %zu tokens, SIMD: %s\n", mb, tokens, simd);
+	printf("classify, LETTERS search: %10.1f MB/s\n", mb / before);
+	printf("classify, CharClass.h:    %10.1f MB/s\n", mb / after);
+	printf("Lexer::parse_tokens:      %10.1f MB/s\n", mb / lex);
+
+	return before_runs == after_runs ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchInput.h"
+#include "Arena.h"
+#include "Lexer.h"
+#include "Parser.h"
+
+// how parallel lexing and parsing scale from 1 to N worker threads, on one
+// generated input. With one thread both fall back to the serial path. Usage:
+//   thread_scaling_bench [megabytes] [max threads]
+
+int main(int argc, char** argv)
+{
+	size_t megabytes = argc > 1 ? (size_t) atoi(argv[1]) : 64;
+	size_t max_threads = argc > 2 ? (size_t) atoi(argv[2]) : std::thread::hardware_concurrency();
+	if (max_threads == 0) max_threads = 1;
+
+	std::string text = generate_program(megabytes << 20);
+	double mb = text.size() / (1024.0 * 1024.0);
+
+	printf("input: %.1f MB, %u hardware threads\n", mb, std::thread::hardware_concurrency());
+	printf("%8s %12s %9s %12s %9s\n", "threads", "lex MB/s", "speedup", "parse MB/s", "speedup");
+
+	// powers of two, and the full count last
+	std::vector<size_t> counts;
+	for (size_t threads = 1; threads < max_threads; threads *= 2) counts.push_back(threads);
+	counts.push_back(max_threads);
+
+	double lex_one = 0.0, parse_one = 0.0;
+
+	for (size_t threads : counts)
+	{
+		Chronos::ThreadPool pool(threads);
+
+		double lex = best_of(3, [&]
+		{
+			Chronos::StringTable strings;
+			Chronos::Lexer lexer(strings);
+			lexer.load_text(text.data(), text.size());
+			lexer.parse_tokens(pool);
+		});
+
+		Chronos::StringTable strings;
+		Chronos::Lexer lexer(strings);
+		lexer.load_text(text.data(), text.size());
+		lexer.parse_tokens(pool);
+		std::deque<Chronos::Token> tokens = lexer.take_tokens();
+
+		double parse = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			Chronos::Arena arena;
+			Chronos::Parser parser(arena);
+			parser.load_tokens(std::deque<Chronos::Token>(tokens));
+
+			double seconds = best_of(1, [&] { parser.parse_program(pool); });
+			if (seconds < parse) parse = seconds;
+		}
+
+		if (threads == 1)
+		{
+			lex_one = lex;
+			parse_one = parse;
+		}
+
+		printf("%8zu %12.1f %8.2fx %12.1f %8.2fx\n", threads, mb / lex, lex_one / lex, mb / parse, parse_one / parse);
+	}
+
+	return 0;
+}
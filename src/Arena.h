@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Debug.h"
+#include "MemoryStats.h"
+
+namespace Chronos
+{
+	// bump allocator for everything that lives as long as one compilation,
+	// nothing is freed on its own, all blocks are released together in reset()
+	// or on destruction. Destructors of the objects are never run, so only
+	// put things in here whose memory is also owned by the arena
+	class Arena
+	{
+	private:
+		static const size_t BLOCK_SIZE = 64 * 1024;
+
+		struct Block
+		{
+			char* data;
+			size_t size;
+		};
+
+		std::vector<Block> m_Blocks;
+		char* m_Cursor = nullptr;
+		char* m_End = nullptr;
+
+		static uintptr_t align_up(void* p, size_t align)
+		{
+			return ((uintptr_t) p + align - 1) & ~(uintptr_t) (align - 1);
+		}
+
+		char* allocate_block(size_t size)
+		{
+			char* block = (char*) std::malloc(size);
+			if (!block) throw std::bad_alloc();
+			m_Blocks.push_back({ block, size });
+			MemoryStats::on_alloc(size);
+			return block;
+		}
+
+	public:
+		Arena() {}
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		~Arena()
+		{
+			reset();
+		}
+
+		void* allocate(size_t size, size_t align)
+		{
+			uintptr_t cursor = align_up(m_Cursor, align);
+
+			if (m_Cursor == nullptr || cursor + size > (uintptr_t) m_End)
+			{
+				// oversized requests get their own block so the current one stays usable
+				if (size + align > BLOCK_SIZE / 4) return (void*) align_up(allocate_block(size + align), align);
+
+				m_Cursor = allocate_block(BLOCK_SIZE);
+				m_End = m_Cursor + BLOCK_SIZE;
+				cursor = align_up(m_Cursor, align);
+			}
+
+			m_Cursor = (char*) (cursor + size);
+			return (void*) cursor;
+		}
+
+		template<typename T, typename... Args>
+		T* make(Args&&... args)
+		{
+			return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		// takes over every block of 'other', its objects now live as long as this arena
+		void adopt(Arena& other)
+		{
+			m_Blocks.insert(m_Blocks.end(), other.m_Blocks.begin(), other.m_Blocks.end());
+			other.m_Blocks.clear();
+			other.m_Cursor = nullptr;
+			other.m_End = nullptr;
+		}
+
+		void reset()
+		{
+			for (Block& block : m_Blocks)
+			{
+				MemoryStats::on_free(block.size);
+				std::free(block.data);
+			}
+			m_Blocks.clear();
+			m_Cursor = nullptr;
+			m_End = nullptr;
+		}
+	};
+
+	// lets standard containers inside arena objects take their storage from the arena
+	template<typename T>
+	struct ArenaAllocator
+	{
+		using value_type = T;
+
+		Arena* arena;
+
+		ArenaAllocator(Arena& a)
+			: arena(&a) {}
+
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other)
+			: arena(other.arena) {}
+
+		T* allocate(size_t n) { return (T*) arena->allocate(n * sizeof(T), alignof(T)); }
+		void deallocate(T*, size_t) {}
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+	};
+}
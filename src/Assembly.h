@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+namespace Chronos
+{
+	// the instructions the compiler emits, close() writes them out as NASM
+	namespace x86ASM
+	{
+		using Label = const char*;
+		struct SubLabel
+		{
+			uint32_t count = 0;
+		};
+
+		enum Section : uint8_t
+		{
+			DATA = 0,
+			BSS,
+			TEXT,
+			NO_SECTION,
+		};
+
+		enum InstType : uint16_t
+		{
+			#define INST_TYPE(a) a,
+			#define REGISTER(a)
+			#include "x86ASM.h"
+		};
+
+		enum class Reg : uint8_t
+		{
+			#define INST_TYPE(a)
+			#define REGISTER(a) a,
+			#include "x86ASM.h"
+		};
+
+		enum DerefSize : uint8_t
+		{
+			BYTE = 0,
+			WORD,
+			DWORD,
+			QWORD,
+			ADDRESS,		// brackets without a size, the operand of LEA
+			NO_DEREF,
+		};
+
+		enum ReserveSize : uint8_t
+		{
+			RESB = 0,
+			RESW,
+			RESQ,
+			NO_RESERVE,
+		};
+
+		enum DefineSize : uint8_t
+		{
+			DB = 0,
+			DW,
+			DQ,
+			NO_DEFINE,
+		};
+
+		enum MemAdressType
+		{
+			REGISTER = 0,
+			LABEL_ADR,
+			SUB_LABEL_ADR,
+		};
+
+		using MemAdress = std::variant<Reg, const char*, SubLabel>;
+
+		struct MemAccess
+		{
+			MemAdress adress = Reg::NO_REG;
+			int offset = 0;
+			DerefSize size = NO_DEREF;
+			// added as index * scale, scale is 1, 2, 4 or 8
+			Reg index = Reg::NO_REG;
+			uint8_t scale = 1;
+
+			MemAccess(const char* adr)
+				: adress(adr) {}
+			MemAccess(SubLabel l)
+				: adress(l) {}
+			MemAccess(Reg reg)
+				: adress(reg) {}
+			MemAccess(Reg reg, int off)
+				: adress(reg), offset(off) {}
+			MemAccess(const char* adr, int off)
+				: adress(adr), offset(off) {}
+			MemAccess(Reg reg, int off, DerefSize s)
+				: adress(reg), offset(off), size(s) {}
+			MemAccess(const char* reg, int off, DerefSize s)
+				: adress(reg), offset(off), size(s) {}
+			MemAccess(Reg reg, Reg idx, uint8_t sc)
+				: adress(reg), size(ADDRESS), index(idx), scale(sc) {}
+		};
+
+		struct ReserveMem
+		{
+			const char* name;
+			ReserveSize size = NO_RESERVE;
+			int count;
+		};
+
+
+		struct DefineMem
+		{
+			const char* name;
+			DefineSize size = NO_DEFINE;
+			std::vector<std::variant<const char*, int>> bytes;
+		};
+
+
+		static const int MEM_ACCESS = 0;
+		static const int INT_VALUE = 1;
+		static const int FLOAT_VALUE = 2;
+		static const int NO_ADR = 3;
+
+		struct BasicInst
+		{
+			InstType type;
+			std::variant<MemAccess, int, float, bool> adresses[2] = { false, false };
+
+		};
+
+		enum InstructionType : uint8_t
+		{
+			BASIC_INST = 0,
+			RESERVE_MEM,
+			DEFINE_MEM,
+			SECTION,
+			SUB_LABEL,
+		};
+
+		using Instruction = std::variant<BasicInst, ReserveMem, DefineMem, Section, SubLabel>;
+	}
+}
@@ -0,0 +1,164 @@
+#include "AstCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace Chronos
+{
+	static const char MAGIC[4] = { 'C', 'H', 'A', 'S' };
+
+	// every array starts 4 byte aligned so it can be read in place from the mapping
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t node_count;
+		uint32_t statement_count;
+		uint32_t symbol_count;
+		uint32_t padding;
+	};
+
+	static_assert(sizeof(CacheHeader) == 32, "cache header layout changed");
+	static_assert(sizeof(TokenValue) == 4 && sizeof(Span) == 12, "cache node layout changed");
+	static_assert(sizeof(Symbol) == 12, "cache symbol layout changed");
+
+	static size_t align4(size_t size)
+	{
+		return (size + 3) & ~(size_t) 3;
+	}
+
+	static size_t entry_size(uint32_t node_count, uint32_t statement_count, uint32_t symbol_count)
+	{
+		size_t size = sizeof(CacheHeader);
+		size += 3 * align4(node_count);	// kinds, ops, types
+		size += node_count * (2 * sizeof(uint32_t) + sizeof(TokenValue) + sizeof(Span));
+		size += statement_count * sizeof(uint32_t);
+		size += symbol_count * sizeof(Symbol);
+		return size;
+	}
+
+	// FNV-1a over the length and bytes of every file, in order
+	uint64_t AstCache::hash_sources(const std::vector<File>& files)
+	{
+		uint64_t hash = 14695981039346656037ull;
+
+		auto mix = [&hash](const void* data, size_t size)
+		{
+			const unsigned char* bytes = (const unsigned char*) data;
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+
+		for (const File& file : files)
+		{
+			std::string_view text = file.view();
+			uint64_t size = text.size();
+			mix(&size, sizeof(size));
+			mix(text.data(), text.size());
+		}
+
+		return hash;
+	}
+
+	std::string AstCache::path_of(uint64_t key) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.ast", (unsigned long long) key);
+		return m_Directory + "/" + name;
+	}
+
+	template<typename T>
+	static const char* read_array(const char* cursor, std::vector<T>& out, uint32_t count)
+	{
+		const T* begin = (const T*) cursor;
+		out.assign(begin, begin + count);
+		return cursor + align4(count * sizeof(T));
+	}
+
+	template<typename T>
+	static void write_array(std::ofstream& out, const std::vector<T>& values)
+	{
+		static const char zeros[4] = {};
+		size_t size = values.size() * sizeof(T);
+		out.write((const char*) values.data(), size);
+		out.write(zeros, align4(size) - size);
+	}
+
+	bool AstCache::load(uint64_t key, FlatAST& ast, SymbolTable& symbols) const
+	{
+		MappedFile file;
+		if (!file.map(path_of(key)) || file.size() < sizeof(CacheHeader)) return false;
+
+		CacheHeader header;
+		std::memcpy(&header, file.data(), sizeof(header));
+
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+		if (header.version != VERSION || header.key != key) return false;
+		if (file.size() != entry_size(header.node_count, header.statement_count, header.symbol_count)) return false;
+
+		ast.clear();
+		const char* cursor = file.data() + sizeof(CacheHeader);
+		cursor = read_array(cursor, ast.kinds, header.node_count);
+		cursor = read_array(cursor, ast.ops, header.node_count);
+		cursor = read_array(cursor, ast.types, header.node_count);
+		cursor = read_array(cursor, ast.lhs, header.node_count);
+		cursor = read_array(cursor, ast.rhs, header.node_count);
+		cursor = read_array(cursor, ast.values, header.node_count);
+		cursor = read_array(cursor, ast.spans, header.node_count);
+		cursor = read_array(cursor, ast.statements, header.statement_count);
+
+		std::vector<Symbol> loaded;
+		cursor = read_array(cursor, loaded, header.symbol_count);
+
+		symbols.clear();
+		for (const Symbol& symbol : loaded) symbols.add(symbol);
+		return true;
+	}
+
+	void AstCache::store(uint64_t key, const FlatAST& ast, const SymbolTable& symbols) const
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_Directory, error);
+		if (error) return;
+
+		// written next to the entry and renamed, a reader never sees half a file
+		std::string path = path_of(key);
+		std::string tmp_path = path + ".tmp";
+
+		bool written = false;
+		{
+			std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+			if (!out) return;
+
+			CacheHeader header = {};
+			std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+			header.version = VERSION;
+			header.key = key;
+			header.node_count = ast.size();
+			header.statement_count = (uint32_t) ast.statements.size();
+			header.symbol_count = symbols.size();
+			out.write((const char*) &header, sizeof(header));
+
+			write_array(out, ast.kinds);
+			write_array(out, ast.ops);
+			write_array(out, ast.types);
+			write_array(out, ast.lhs);
+			write_array(out, ast.rhs);
+			write_array(out, ast.values);
+			write_array(out, ast.spans);
+			write_array(out, ast.statements);
+			write_array(out, symbols.get_symbols());
+
+			written = (bool) out;
+		}
+
+		if (written) std::filesystem::rename(tmp_path, path, error);
+		if (!written || error) std::filesystem::remove(tmp_path, error);
+	}
+}
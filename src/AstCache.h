@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Error.h"
+#include "FlatAST.h"
+#include "SymbolTable.h"
+
+namespace Chronos
+{
+	// stores the type checked FlatAST of a program on disk, keyed by a hash of
+	// its sources. A hit hands back the same nodes, types and symbols without
+	// running the lexer, parser or type checker again
+	class AstCache
+	{
+	private:
+		// bump whenever the layout below or the result of type checking changes
+		static const uint32_t VERSION = 5;
+
+		std::string m_Directory;
+
+		std::string path_of(uint64_t key) const;
+
+	public:
+		AstCache(std::string directory = ".chronos_cache")
+			: m_Directory(std::move(directory)) {}
+
+		static uint64_t hash_sources(const std::vector<File>& files);
+
+		// fills 'ast' and 'symbols', false if there is no valid entry for 'key'
+		bool load(uint64_t key, FlatAST& ast, SymbolTable& symbols) const;
+		void store(uint64_t key, const FlatAST& ast, const SymbolTable& symbols) const;
+	};
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CHRONOS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHRONOS_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Chronos
+{
+	enum CharClass : uint8_t
+	{
+		CHAR_SPACE = 1 << 0,
+		CHAR_NEWLINE = 1 << 1,
+		CHAR_DIGIT = 1 << 2,
+		CHAR_LETTER = 1 << 3,
+	};
+
+	constexpr std::array<uint8_t, 256> make_char_classes()
+	{
+		std::array<uint8_t, 256> table = {};
+
+		table[' '] = CHAR_SPACE;
+		table['\t'] = CHAR_SPACE;
+		table['\r'] = CHAR_SPACE;
+		table['\n'] = CHAR_SPACE | CHAR_NEWLINE;
+
+		for (int c = '0'; c <= '9'; c++) table[c] = CHAR_DIGIT;
+		for (int c = 'a'; c <= 'z'; c++) table[c] = CHAR_LETTER;
+		for (int c = 'A'; c <= 'Z'; c++) table[c] = CHAR_LETTER;
+		table['_'] = CHAR_LETTER;
+
+		return table;
+	}
+
+	constexpr std::array<uint8_t, 256> CHAR_CLASSES = make_char_classes();
+
+	inline bool has_class(char c, uint8_t cls)
+	{
+		return (CHAR_CLASSES[(unsigned char) c] & cls) != 0;
+	}
+
+	inline bool is_space(char c) { return has_class(c, CHAR_SPACE); }
+	inline bool is_letter(char c) { return has_class(c, CHAR_LETTER); }
+	inline bool is_digit(char c) { return has_class(c, CHAR_DIGIT); }
+
+	inline uint32_t count_trailing_zeros(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	// one bit per byte of a SIMD_WIDTH wide block, set where the byte belongs to the class
+#if defined(CHRONOS_AVX2)
+	constexpr std::size_t SIMD_WIDTH = 32;
+
+	using SimdBlock = __m256i;
+
+	inline SimdBlock simd_load(const char* p) { return _mm256_loadu_si256((const __m256i*) p); }
+	inline SimdBlock simd_eq(SimdBlock v, char c) { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)); }
+	inline SimdBlock simd_or(SimdBlock a, SimdBlock b) { return _mm256_or_si256(a, b); }
+	inline uint32_t simd_mask(SimdBlock v) { return (uint32_t) _mm256_movemask_epi8(v); }
+
+	// unsigned (v - lo) <= count - 1
+	inline SimdBlock simd_in_range(SimdBlock v, char lo, char count)
+	{
+		SimdBlock t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+		return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(count - 1)), t);
+	}
+
+	inline SimdBlock simd_lower(SimdBlock v) { return _mm256_or_si256(v, _mm256_set1_epi8(0x20)); }
+#elif defined(CHRONOS_SSE2)
+	constexpr std::size_t SIMD_WIDTH = 16;
+
+	using SimdBlock = __m128i;
+
+	inline SimdBlock simd_load(const char* p) { return _mm_loadu_si128((const __m128i*) p); }
+	inline SimdBlock simd_eq(SimdBlock v, char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+	inline SimdBlock simd_or(SimdBlock a, SimdBlock b) { return _mm_or_si128(a, b); }
+	inline uint32_t simd_mask(SimdBlock v) { return (uint32_t) _mm_movemask_epi8(v); }
+
+	inline SimdBlock simd_in_range(SimdBlock v, char lo, char count)
+	{
+		SimdBlock t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+		return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(count - 1)), t);
+	}
+
+	inline SimdBlock simd_lower(SimdBlock v) { return _mm_or_si128(v, _mm_set1_epi8(0x20)); }
+#endif
+
+#if defined(CHRONOS_AVX2) || defined(CHRONOS_SSE2)
+	constexpr uint32_t SIMD_FULL_MASK = (uint32_t) ((1ull << SIMD_WIDTH) - 1);
+
+	inline uint32_t space_mask(const char* p)
+	{
+		SimdBlock v = simd_load(p);
+		SimdBlock m = simd_or(simd_or(simd_eq(v, ' '), simd_eq(v, '\t')), simd_or(simd_eq(v, '\r'), simd_eq(v, '\n')));
+		return simd_mask(m);
+	}
+
+	inline uint32_t letter_mask(const char* p)
+	{
+		SimdBlock v = simd_load(p);
+		return simd_mask(simd_or(simd_in_range(simd_lower(v), 'a', 26), simd_eq(v, '_')));
+	}
+
+	inline uint32_t digit_mask(const char* p)
+	{
+		return simd_mask(simd_in_range(simd_load(p), '0', 10));
+	}
+
+	inline uint32_t newline_mask(const char* p)
+	{
+		return simd_mask(simd_eq(simd_load(p), '\n'));
+	}
+#endif
+
+	// length of the run of class 'cls' characters at the start of [p, p + size)
+	template<uint32_t(*BlockMask)(const char*)>
+	inline std::size_t scan_run(const char* p, std::size_t size, uint8_t cls)
+	{
+		std::size_t i = 0;
+
+#if defined(CHRONOS_AVX2) || defined(CHRONOS_SSE2)
+		for (; i + SIMD_WIDTH <= size; i += SIMD_WIDTH)
+		{
+			uint32_t outside = ~BlockMask(p + i) & SIMD_FULL_MASK;
+			if (outside) return i + count_trailing_zeros(outside);
+		}
+#endif
+
+		while (i < size && has_class(p[i], cls)) ++i;
+		return i;
+	}
+
+#if defined(CHRONOS_AVX2) || defined(CHRONOS_SSE2)
+	inline std::size_t scan_spaces(const char* p, std::size_t size) { return scan_run<space_mask>(p, size, CHAR_SPACE); }
+	inline std::size_t scan_letters(const char* p, std::size_t size) { return scan_run<letter_mask>(p, size, CHAR_LETTER); }
+	inline std::size_t scan_digits(const char* p, std::size_t size) { return scan_run<digit_mask>(p, size, CHAR_DIGIT); }
+#else
+	inline uint32_t no_mask(const char*) { return 0; }
+
+	inline std::size_t scan_spaces(const char* p, std::size_t size) { return scan_run<no_mask>(p, size, CHAR_SPACE); }
+	inline std::size_t scan_letters(const char* p, std::size_t size) { return scan_run<no_mask>(p, size, CHAR_LETTER); }
+	inline std::size_t scan_digits(const char* p, std::size_t size) { return scan_run<no_mask>(p, size, CHAR_DIGIT); }
+#endif
+
+	// calls f(index) for every '\n' in [p, p + size), in order
+	template<typename F>
+	inline void for_each_newline(const char* p, std::size_t size, F f)
+	{
+		std::size_t i = 0;
+
+#if defined(CHRONOS_AVX2) || defined(CHRONOS_SSE2)
+		for (; i + SIMD_WIDTH <= size; i += SIMD_WIDTH)
+		{
+			uint32_t mask = newline_mask(p + i);
+			while (mask)
+			{
+				f(i + count_trailing_zeros(mask));
+				mask &= mask - 1;
+			}
+		}
+#endif
+
+		for (; i < size; i++)
+		{
+			if (p[i] == '\n') f(i);
+		}
+	}
+}
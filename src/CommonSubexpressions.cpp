@@ -0,0 +1,221 @@
+#include "CommonSubexpressions.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace Chronos
+{
+	struct ValueKey
+	{
+		NodeType kind;
+		TokenType op;
+		ValueType type;
+		uint32_t a;		// left operand number, literal bits or symbol
+		uint32_t b;		// right operand number or version of the symbol
+
+		bool operator==(const ValueKey& other) const
+		{
+			return kind == other.kind && op == other.op && type == other.type && a == other.a && b == other.b;
+		}
+	};
+
+	struct ValueKeyHash
+	{
+		size_t operator()(const ValueKey& key) const
+		{
+			uint64_t h = ((uint64_t) key.a << 32) | key.b;
+			h ^= ((uint64_t) key.kind << 16 | (uint64_t) key.op << 8 | (uint64_t) key.type) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 29;
+			return (size_t) (h * 0xBF58476D1CE4E5B9ull);
+		}
+	};
+
+	// right operands of AND/OR only run sometimes, a value computed in one of them
+	// is only available further inside the same operand
+	struct Region
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	static const uint32_t NO_REGION = UINT32_MAX;
+
+	static std::vector<uint32_t> innermost_regions(const FlatAST& ast, std::vector<Region>& regions)
+	{
+		std::vector<uint32_t> first(ast.size());
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			first[i] = ast.lhs[i] == FlatAST::NO_NODE ? i : first[ast.lhs[i]];
+
+			bool logic = ast.ops[i] == TokenType::KW_AND || ast.ops[i] == TokenType::KW_OR;
+			if (ast.kinds[i] == NodeType::BINOP && logic) regions.push_back({ first[ast.rhs[i]], ast.rhs[i] });
+		}
+
+		// regions nest, outer ones first when they start at the same node
+		std::sort(regions.begin(), regions.end(), [](const Region& l, const Region& r)
+		{
+			return l.begin < r.begin || (l.begin == r.begin && l.end > r.end);
+		});
+
+		std::vector<uint32_t> innermost(ast.size(), NO_REGION);
+		std::vector<uint32_t> open;
+		size_t next = 0;
+
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			while (!open.empty() && regions[open.back()].end < i) open.pop_back();
+			while (next < regions.size() && regions[next].begin == i) open.push_back((uint32_t) next++);
+
+			if (!open.empty()) innermost[i] = open.back();
+		}
+
+		return innermost;
+	}
+
+	static std::vector<uint32_t> number_values(const FlatAST& ast, const SymbolTable& symbols)
+	{
+		std::unordered_map<ValueKey, uint32_t, ValueKeyHash> numbers;
+		std::vector<uint32_t> version(symbols.size(), 0);
+		std::vector<uint32_t> value(ast.size());
+		uint32_t next = 0;
+
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			ValueKey key = { ast.kinds[i], ast.ops[i], ast.types[i], 0, 0 };
+
+			switch (ast.kinds[i])
+			{
+			case NodeType::NUM:
+				std::memcpy(&key.a, &ast.values[i], sizeof(key.a));
+				break;
+			case NodeType::ACCESS:
+				key.a = ast.values[i].symbol;
+				key.b = version[ast.values[i].symbol];
+				break;
+			case NodeType::BINOP:
+				key.a = value[ast.lhs[i]];
+				key.b = value[ast.rhs[i]];
+				break;
+			case NodeType::UNRYOP:
+				key.a = value[ast.lhs[i]];
+				break;
+			case NodeType::ASSIGN:
+				// a store is never shared, later reads see a new version
+				version[ast.values[i].symbol]++;
+				value[i] = next++;
+				continue;
+			case NodeType::ROOT:
+				ASSERT(false, "ROOT node in a flat AST");
+				break;
+			}
+
+			auto it = numbers.find(key);
+			if (it == numbers.end()) it = numbers.emplace(key, next++).first;
+			value[i] = it->second;
+		}
+
+		return value;
+	}
+
+	void eliminate_common_subexpressions(FlatAST& ast, SymbolTable& symbols)
+	{
+		std::vector<Region> regions;
+		std::vector<uint32_t> region = innermost_regions(ast, regions);
+		std::vector<uint32_t> value = number_values(ast, symbols);
+
+		// walks every statement parents first. A node that already has a computed
+		// copy reuses it and its operands are skipped, every other node becomes
+		// available for later copies once its operands are done
+		std::unordered_map<uint32_t, std::vector<uint32_t>> available;
+		std::vector<uint32_t> reuses(ast.size(), FlatAST::NO_NODE);
+		std::vector<bool> provides(ast.size(), false);
+		std::vector<std::pair<uint32_t, bool>> stack;
+		bool changed = false;
+
+		for (uint32_t statement : ast.statements)
+		{
+			stack.push_back({ statement, false });
+
+			while (!stack.empty())
+			{
+				auto [node, expanded] = stack.back();
+				stack.pop_back();
+
+				bool shareable = ast.kinds[node] == NodeType::BINOP || ast.kinds[node] == NodeType::UNRYOP;
+
+				if (expanded)
+				{
+					if (shareable) available[value[node]].push_back(node);
+					continue;
+				}
+
+				if (shareable)
+				{
+					auto it = available.find(value[node]);
+					if (it != available.end())
+					{
+						for (auto copy = it->second.rbegin(); copy != it->second.rend(); ++copy)
+						{
+							uint32_t r = region[*copy];
+							if (r != NO_REGION && (node < regions[r].begin || node > regions[r].end)) continue;
+
+							reuses[node] = *copy;
+							provides[*copy] = true;
+							changed = true;
+							break;
+						}
+					}
+
+					if (reuses[node] != FlatAST::NO_NODE) continue;
+				}
+
+				stack.push_back({ node, true });
+				if (ast.rhs[node] != FlatAST::NO_NODE) stack.push_back({ ast.rhs[node], false });
+				if (ast.lhs[node] != FlatAST::NO_NODE) stack.push_back({ ast.lhs[node], false });
+			}
+		}
+
+		if (!changed) return;
+
+		// the first copy stores into a temporary as it is computed, the ASSIGN keeps
+		// the value for its parent, and the others read it back
+		std::vector<uint32_t> temporary(ast.size(), SymbolTable::NO_SYMBOL);
+		std::vector<uint32_t> moved_to(ast.size(), FlatAST::NO_NODE);
+		std::vector<bool> skipped(ast.size(), false);
+		FlatAST rewritten;
+
+		for (uint32_t i = ast.size(); i > 0; i--)
+		{
+			uint32_t node = i - 1;
+			if (!skipped[node] && reuses[node] == FlatAST::NO_NODE) continue;
+
+			if (ast.lhs[node] != FlatAST::NO_NODE) skipped[ast.lhs[node]] = true;
+			if (ast.rhs[node] != FlatAST::NO_NODE) skipped[ast.rhs[node]] = true;
+		}
+
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			if (skipped[i]) continue;
+
+			if (reuses[i] != FlatAST::NO_NODE)
+			{
+				moved_to[i] = rewritten.add(NodeType::ACCESS, TokenType::ID, FlatAST::NO_NODE, FlatAST::NO_NODE, temporary[reuses[i]], ast.types[i], ast.spans[i]);
+				continue;
+			}
+
+			uint32_t left = ast.lhs[i] == FlatAST::NO_NODE ? FlatAST::NO_NODE : moved_to[ast.lhs[i]];
+			uint32_t right = ast.rhs[i] == FlatAST::NO_NODE ? FlatAST::NO_NODE : moved_to[ast.rhs[i]];
+			moved_to[i] = rewritten.add(ast.kinds[i], ast.ops[i], left, right, ast.values[i], ast.types[i], ast.spans[i]);
+
+			if (provides[i])
+			{
+				temporary[i] = symbols.make_temporary(ast.types[i]);
+				moved_to[i] = rewritten.add(NodeType::ASSIGN, TokenType::ASSIGN, moved_to[i], FlatAST::NO_NODE, temporary[i], ast.types[i], ast.spans[i]);
+			}
+		}
+
+		for (uint32_t statement : ast.statements) rewritten.statements.push_back(moved_to[statement]);
+		ast = std::move(rewritten);
+	}
+}
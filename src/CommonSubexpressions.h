@@ -0,0 +1,15 @@
+#pragma once
+
+#include "FlatAST.h"
+#include "SymbolTable.h"
+
+namespace Chronos
+{
+	// hash-conses the typed FlatAST into value numbers keyed on operator, operand
+	// numbers and type. A subexpression that was already computed on every path to
+	// it is replaced by a read of a temporary, the first computation stores into
+	// that temporary. Variables get a new number on every store, so a reuse never
+	// reaches across an ASSIGN to one of its operands. 'ast' has to be type checked
+	// with 'symbols' and contain the whole program
+	void eliminate_common_subexpressions(FlatAST& ast, SymbolTable& symbols);
+}
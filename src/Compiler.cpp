@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <bitset>
 #include <sstream>
 
@@ -30,6 +35,7 @@ namespace Chronos
 		case BYTE: return "BYTE";
 		case WORD: return "WORD";
 		case DWORD: return "DWORD";
+		case ADDRESS: return "";
 		}
 
 		ASSERT(false, "to_string for ASMSize not defined");
@@ -158,32 +164,50 @@ namespace Chronos
 	std::string to_string(const MemAccess& acc)
 	{
 		std::string s = "";
-		if (acc.size != DerefSize::NO_DEREF)
+		if (acc.size == DerefSize::ADDRESS) s += "[";
+		else if (acc.size != DerefSize::NO_DEREF)
 		{
 			s += to_string(acc.size);
 			s += " [";
 		}
 		s += to_string(acc.adress);
+		if (acc.index != Reg::NO_REG) s += "+" + to_string(acc.index) + "*" + std::to_string(acc.scale);
 		if (acc.offset > 0) s += "+" + std::to_string(acc.offset);
 		else if (acc.offset < 0) s += std::to_string(acc.offset);
 		if (acc.size != DerefSize::NO_DEREF) s += "]";
 		return s;
 	}
 
+	// enough digits to get the exact float back, NASM needs the '.' to read it as a float
+	std::string float_to_string(float f)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.9g", f);
+
+		std::string s = buffer;
+		if (s.find('.') == std::string::npos)
+		{
+			size_t exponent = s.find('e');
+			s.insert(exponent == std::string::npos ? s.size() : exponent, ".0");
+		}
+		return s;
+	}
+
 	std::string to_string(const std::variant<MemAccess, int, float, bool>& acc)
 	{
 		if (acc.index() == MEM_ACCESS) return to_string(std::get<MemAccess>(acc));
 		else if (acc.index() == INT_VALUE) return int_to_hex(std::get<int>(acc));
-		else if (acc.index() == FLOAT_VALUE) return "__float32__(" + std::to_string(std::get<float>(acc)) + ")";
+		else if (acc.index() == FLOAT_VALUE) return "__float32__(" + float_to_string(std::get<float>(acc)) + ")";
 		ASSERT(false, "acces type not defined");
 		return "";
 	}
 
 	std::string to_string(const BasicInst& inst)
 	{
-		std::string s = to_string(inst.type) + " ";
+		std::string s = to_string(inst.type);
+		if (inst.adresses[0].index() == NO_ADR) return s;
 
-		s += to_string(inst.adresses[0]);
+		s += " " + to_string(inst.adresses[0]);
 		if (inst.adresses[1].index() != NO_ADR) s += ", " + to_string(inst.adresses[1]);
 		return s;
 	}
@@ -241,8 +265,20 @@ namespace Chronos
 		return res;
 	}
 
+	size_t Compiler::peephole()
+	{
+		size_t rewrites = 0;
+		for (auto& pair : m_Code) rewrites += m_Peephole.run(pair.second);
+
+		m_PeepholeDone = true;
+		return rewrites;
+	}
+
 	void Compiler::close()
 	{
+		if (m_UsePeephole && !m_PeepholeDone) peephole();
+		m_PeepholeDone = false;
+
 		m_Output << to_string(m_Code);
 		m_Output << std::endl;
 		m_Output.close();
@@ -252,6 +288,13 @@ namespace Chronos
 		m_Code.clear();
 	}
 
+	size_t Compiler::instruction_count() const
+	{
+		size_t count = 0;
+		for (auto& pair : m_Code) count += pair.second.size();
+		return count;
+	}
+
 	SubLabel Compiler::sub_label()
 	{
 		return SubLabel{ m_CurrentSubLabel };
@@ -279,6 +322,11 @@ namespace Chronos
 		}
 	}
 
+	void Compiler::write(InstType t)
+	{
+		write(Instruction{ BasicInst{ t, { false, false } } });
+	}
+
 	void Compiler::write(InstType t, MemAccess a)
 	{
 		write(Instruction{ BasicInst{ t, { a, false } } });
@@ -337,35 +385,338 @@ namespace Chronos
 		write(CALL, "printf");
 	}
 
+	static const Reg GP_REGS[] = { Reg::EAX, Reg::ECX, Reg::EDX, Reg::EBX, Reg::ESI, Reg::EDI };
+	static const Reg XMM_REGS[] = { Reg::XMM0, Reg::XMM1, Reg::XMM2, Reg::XMM3, Reg::XMM4, Reg::XMM5, Reg::XMM6, Reg::XMM7 };
+
+	static uint64_t bit(Reg reg)
+	{
+		return 1ull << (uint32_t) reg;
+	}
+
+	static bool is_xmm(Reg reg)
+	{
+		return reg >= Reg::XMM0 && reg <= Reg::XMM7;
+	}
+
+	// SETcc needs an 8 bit register, ESI and EDI have none
+	static Reg low_byte(Reg reg)
+	{
+		switch (reg)
+		{
+		case Reg::EAX: return Reg::AL;
+		case Reg::ECX: return Reg::CL;
+		case Reg::EDX: return Reg::DL;
+		case Reg::EBX: return Reg::BL;
+		default: break;
+		}
+
+		ASSERT(false, "register has no low byte");
+		return Reg::NO_REG;
+	}
+
+	void Compiler::reset_registers(uint32_t spill_base)
+	{
+		m_Operands.clear();
+		m_Snapshots.clear();
+		for (uint32_t& owner : m_RegOwner) owner = REG_FREE;
+
+		m_SpillBase = spill_base;
+		m_SpillCount = 0;
+		m_MaxSpills = 0;
+		m_FreeSpills.clear();
+	}
+
+	// a free register marked busy, the oldest pending value is spilled if there is none
+	Reg Compiler::alloc_reg(bool xmm, uint64_t exclude, Reg prefer)
+	{
+		if (prefer != Reg::NO_REG && is_xmm(prefer) == xmm && !(exclude & bit(prefer)) && m_RegOwner[(size_t) prefer] == REG_FREE)
+		{
+			m_RegOwner[(size_t) prefer] = REG_BUSY;
+			return prefer;
+		}
+
+		auto try_free = [&](Reg reg)
+		{
+			if ((exclude & bit(reg)) || m_RegOwner[(size_t) reg] != REG_FREE) return false;
+			m_RegOwner[(size_t) reg] = REG_BUSY;
+			return true;
+		};
+
+		if (xmm) { for (Reg reg : XMM_REGS) if (try_free(reg)) return reg; }
+		else { for (Reg reg : GP_REGS) if (try_free(reg)) return reg; }
+
+		// the oldest value is the one needed last
+		for (uint32_t i = 0; i < m_Operands.size(); i++)
+		{
+			Operand& value = m_Operands[i];
+			if (value.kind != Operand::REG || is_xmm(value.reg) != xmm || (exclude & bit(value.reg))) continue;
+
+			Reg reg = value.reg;
+			spill(i);
+			m_RegOwner[(size_t) reg] = REG_BUSY;
+			return reg;
+		}
+
+		ASSERT(false, "out of registers");
+		return Reg::NO_REG;
+	}
+
+	Reg Compiler::alloc_byte_reg(Reg prefer)
+	{
+		return alloc_reg(false, bit(Reg::ESI) | bit(Reg::EDI), prefer);
+	}
+
+	void Compiler::release(Reg reg)
+	{
+		m_RegOwner[(size_t) reg] = REG_FREE;
+	}
+
+	int Compiler::spill_slot()
+	{
+		if (!m_FreeSpills.empty())
+		{
+			int offset = m_FreeSpills.back();
+			m_FreeSpills.pop_back();
+			return offset;
+		}
+
+		m_SpillCount++;
+		m_MaxSpills = std::max(m_MaxSpills, m_SpillCount);
+		return (int) (m_SpillBase + 4 * m_SpillCount);
+	}
+
+	void Compiler::free_spill(int offset)
+	{
+		m_FreeSpills.push_back(offset);
+	}
+
+	// spills and reloads are plain moves, they never change the flags
+	void Compiler::spill(uint32_t operand)
+	{
+		Operand& value = m_Operands[operand];
+		int offset = spill_slot();
+
+		write(is_xmm(value.reg) ? MOVSS : MOV, { Reg::EBP, -offset, DWORD }, value.reg);
+		release(value.reg);
+
+		value.kind = Operand::SPILL;
+		value.reg = Reg::NO_REG;
+		value.value = offset;
+	}
+
+	// frees 'reg' for an instruction that needs it, the value it holds moves to
+	// a register outside 'exclude' or to a spill slot
+	void Compiler::claim(Reg reg, uint64_t exclude)
+	{
+		uint32_t owner = m_RegOwner[(size_t) reg];
+		ASSERT(owner != REG_BUSY, "register is already in use");
+
+		if (owner != REG_FREE)
+		{
+			bool xmm = is_xmm(reg);
+			const Reg* regs = xmm ? XMM_REGS : GP_REGS;
+			size_t count = xmm ? std::size(XMM_REGS) : std::size(GP_REGS);
+
+			Reg moved = Reg::NO_REG;
+			for (size_t i = 0; i < count && moved == Reg::NO_REG; i++)
+			{
+				if (!(exclude & bit(regs[i])) && regs[i] != reg && m_RegOwner[(size_t) regs[i]] == REG_FREE) moved = regs[i];
+			}
+
+			if (moved == Reg::NO_REG) spill(owner);
+			else
+			{
+				write(xmm ? MOVSS : MOV, moved, reg);
+				m_Operands[owner].reg = moved;
+				m_RegOwner[(size_t) moved] = owner;
+			}
+		}
+
+		m_RegOwner[(size_t) reg] = REG_BUSY;
+	}
+
+	void Compiler::push_reg(Reg reg, ValueType type)
+	{
+		m_RegOwner[(size_t) reg] = (uint32_t) m_Operands.size();
+		m_Operands.push_back({ Operand::REG, type, reg, 0 });
+	}
+
+	void Compiler::push_imm(int value, ValueType type)
+	{
+		m_Operands.push_back({ Operand::IMM, type, Reg::NO_REG, value });
+	}
+
+	static float imm_float(int value)
+	{
+		float f;
+		std::memcpy(&f, &value, sizeof(f));
+		return f;
+	}
+
+	// NASM reads float immediates back exactly, the listing stays readable
+	void Compiler::write_imm(InstType t, MemAccess a, const Operand& imm)
+	{
+		if (imm.type == ValueType::FLOAT) write(t, a, imm_float(imm.value));
+		else write(t, a, imm.value);
+	}
+
+	// the register of a popped value stays busy until it is released
+	Compiler::Operand Compiler::pop()
+	{
+		ASSERT(!m_Operands.empty(), "no operand left");
+
+		Operand value = m_Operands.back();
+		m_Operands.pop_back();
+		if (value.kind == Operand::REG) m_RegOwner[(size_t) value.reg] = REG_BUSY;
+		return value;
+	}
+
+	void Compiler::pop_operands(bool swapped, Operand& left, Operand& right)
+	{
+		if (swapped)
+		{
+			left = pop();
+			right = pop();
+		}
+		else
+		{
+			right = pop();
+			left = pop();
+		}
+	}
+
+	// loads a popped value into a busy register of its own type
+	Reg Compiler::to_reg(Operand value, uint64_t exclude)
+	{
+		if (value.kind == Operand::REG) return value.reg;
+
+		if (value.kind == Operand::IMM && value.type == ValueType::FLOAT)
+		{
+			// there is no move of an immediate into an XMM register
+			Reg bits = alloc_reg(false);
+			Reg reg = alloc_reg(true, exclude);
+			write_imm(MOV, bits, value);
+			write(MOVD, reg, bits);
+			release(bits);
+			return reg;
+		}
+
+		Reg reg = alloc_reg(value.type == ValueType::FLOAT, exclude);
+
+		if (value.kind == Operand::IMM) write(MOV, reg, value.value);
+		else
+		{
+			write(value.type == ValueType::FLOAT ? MOVSS : MOV, reg, { Reg::EBP, -value.value, DWORD });
+			free_spill(value.value);
+		}
+
+		return reg;
+	}
+
+	// like to_reg, an INT is converted on the way
+	Reg Compiler::to_xmm(Operand value)
+	{
+		if (value.type == ValueType::FLOAT) return to_reg(value);
+
+		if (value.kind == Operand::SPILL)
+		{
+			Reg reg = alloc_reg(true);
+			write(CVTSI2SS, reg, { Reg::EBP, -value.value, DWORD });
+			free_spill(value.value);
+			return reg;
+		}
+
+		Reg source = to_reg(value);
+		Reg reg = alloc_reg(true);
+		write(CVTSI2SS, reg, source);
+		release(source);
+		return reg;
+	}
+
+	void Compiler::take_snapshot()
+	{
+		auto& regs = m_Snapshots.emplace_back();
+		for (uint32_t i = 0; i < m_Operands.size(); i++)
+		{
+			if (m_Operands[i].kind == Operand::REG) regs.push_back({ i, m_Operands[i].reg });
+		}
+	}
+
+	// puts back what an operand of an AND/OR spilled or moved for a DIV before it
+	// jumps, moved values go through a spill slot so no register is overwritten
+	void Compiler::restore_snapshot()
+	{
+		for (auto [operand, reg] : m_Snapshots.back())
+		{
+			Operand& value = m_Operands[operand];
+			if (value.kind == Operand::REG && value.reg != reg) spill(operand);
+		}
+
+		for (auto [operand, reg] : m_Snapshots.back())
+		{
+			Operand& value = m_Operands[operand];
+			if (value.kind != Operand::SPILL) continue;
+
+			ASSERT(m_RegOwner[(size_t) reg] == REG_FREE, "register of a pending value was taken");
+			write(is_xmm(reg) ? MOVSS : MOV, reg, { Reg::EBP, -value.value, DWORD });
+			free_spill(value.value);
+
+			value.kind = Operand::REG;
+			value.reg = reg;
+			m_RegOwner[(size_t) reg] = operand;
+		}
+	}
+
+	// the frame holds the variables and below them the spill slots
+	void Compiler::reserve_frame(uint32_t size)
+	{
+		BasicInst& sub = std::get<BasicInst>(m_Code.at("main")[m_FrameInst]);
+		sub.adresses[1] = (int) (size + 4 * m_MaxSpills);
+	}
+
 	void Compiler::print_value(ValueType type)
 	{
-		switch (type)
+		Operand value = pop();
+
+		if (type == ValueType::FLOAT)
 		{
-		case ValueType::INT:
-			write(PUSH, "int_format");
-			write(CALL, "printf");
-			break;
-		case ValueType::FLOAT:
+			if (value.kind == Operand::IMM) write(PUSH, imm_float(value.value));
+			else if (value.kind == Operand::SPILL) write(PUSH, { Reg::EBP, -value.value, DWORD });
+			else
+			{
+				Reg reg = to_reg(value);
+				write(SUB, Reg::ESP, 4);
+				write(MOVSS, { Reg::ESP, 0, DWORD }, reg);
+				release(reg);
+			}
+
 			write(CALL, "print_float");
-			break;
-		default:
-			write(PUSH, "hex_format");
-			write(CALL, "printf");
+			return;
 		}
 
+		if (value.kind == Operand::IMM) write(PUSH, value.value);
+		else if (value.kind == Operand::SPILL) write(PUSH, { Reg::EBP, -value.value, DWORD });
+		else
+		{
+			write(PUSH, value.reg);
+			release(value.reg);
+		}
+
+		write(PUSH, type == ValueType::INT ? "int_format" : "hex_format");
+		write(CALL, "printf");
 	}
 
-	void Compiler::zero_cmp_float()
+	void Compiler::zero_cmp_float(Reg value)
 	{
-		write(PXOR, Reg::XMM0, Reg::XMM0);
-		write(ADD, Reg::ESP, 4);
-		write(UCOMISS, Reg::XMM0, { Reg::ESP, -4, DWORD });
+		Reg zero = alloc_reg(true);
+		write(PXOR, zero, zero);
+		write(UCOMISS, value, zero);
+		release(zero);
 	}
 
-	void Compiler::zero_cmp_int()
+	void Compiler::zero_cmp_int(Reg value)
 	{
-		write(POP, Reg::ECX);
-		write(TEST, Reg::ECX, Reg::ECX);
+		write(TEST, value, value);
 	}
 
 	void Compiler::eval_num(Token& t)
@@ -373,12 +724,17 @@ namespace Chronos
 		switch (t.type)
 		{
 		case TokenType::INT:
-			write(PUSH, std::get<int>(t.value));
+			push_imm(t.as_int());
 			break;
 
 		case TokenType::FLOAT:
-			write(PUSH, std::get<float>(t.value));
+		{
+			float f = t.as_float();
+			int bits;
+			std::memcpy(&bits, &f, sizeof(bits));
+			push_imm(bits, ValueType::FLOAT);
 			break;
+		}
 
 		default:
 			ASSERT(false, "num node should not have this token" + to_string(t));
@@ -386,23 +742,208 @@ namespace Chronos
 
 	}
 
-	void Compiler::int_int_binop(TokenType type)
+	static int trailing_zeros(uint32_t value)
+	{
+		int count = 0;
+		for (; !(value & 1); value >>= 1) count++;
+		return count;
+	}
+
+	// multiplier and shift of the signed division by 'divisor', which is not
+	// 0, 1, -1 or a power of two (Hacker's Delight, figure 10-1)
+	static void signed_magic(int divisor, int& multiplier, int& shift)
+	{
+		const uint32_t two31 = 0x80000000u;
+
+		uint32_t magnitude = divisor < 0 ? 0u - (uint32_t) divisor : (uint32_t) divisor;
+		uint32_t t = two31 + ((uint32_t) divisor >> 31);
+		uint32_t anc = t - 1 - t % magnitude;
+
+		uint32_t q1 = two31 / anc;
+		uint32_t r1 = two31 - q1 * anc;
+		uint32_t q2 = two31 / magnitude;
+		uint32_t r2 = two31 - q2 * magnitude;
+		uint32_t delta = 0;
+		int p = 31;
+
+		do
+		{
+			p++;
+			q1 *= 2;
+			r1 *= 2;
+			if (r1 >= anc)
+			{
+				q1++;
+				r1 -= anc;
+			}
+
+			q2 *= 2;
+			r2 *= 2;
+			if (r2 >= magnitude)
+			{
+				q2++;
+				r2 -= magnitude;
+			}
+
+			delta = magnitude - r2;
+		} while (q1 < delta || (q1 == delta && r1 == 0));
+
+		multiplier = (int) (q2 + 1);
+		if (divisor < 0) multiplier = (int) (0u - (uint32_t) multiplier);
+		shift = p - 32;
+	}
+
+	// a factor of 1, 3, 5 or 9 times a power of two is a LEA and a shift,
+	// everything that would take more than two instructions stays an IMUL
+	void Compiler::int_mul_imm(Operand left, int factor)
+	{
+		Reg l = to_reg(left);
+
+		if (factor == 0)
+		{
+			release(l);
+			push_imm(0);
+			return;
+		}
+
+		uint32_t magnitude = factor < 0 ? 0u - (uint32_t) factor : (uint32_t) factor;
+		int shift = trailing_zeros(magnitude);
+		uint32_t odd = magnitude >> shift;
+
+		bool lea = odd == 3 || odd == 5 || odd == 9;
+		int steps = (lea ? 1 : 0) + (shift ? 1 : 0) + (factor < 0 ? 1 : 0);
+
+		if ((odd == 1 || lea) && steps <= 2)
+		{
+			if (lea) write(LEA, l, MemAccess(l, l, (uint8_t) (odd - 1)));
+			if (shift) write(SHL, l, shift);
+			if (factor < 0) write(NEG, l);
+		}
+		else write(IMUL, l, factor);
+
+		push_reg(l, ValueType::INT);
+	}
+
+	// an arithmetic shift rounds down, so a negative dividend gets the divisor - 1
+	// added first to truncate like IDIV. Other divisors multiply by a fixed point
+	// reciprocal and keep the high half, corrected by one for negative results
+	void Compiler::int_div_imm(Operand left, int divisor)
+	{
+		Reg l = to_reg(left);
+		uint32_t magnitude = divisor < 0 ? 0u - (uint32_t) divisor : (uint32_t) divisor;
+
+		if (!(magnitude & (magnitude - 1)))
+		{
+			int shift = trailing_zeros(magnitude);
+
+			if (shift)
+			{
+				Reg bias = alloc_reg(false, bit(l));
+				write(MOV, bias, l);
+				if (shift > 1) write(SAR, bias, 31);
+				write(SHR, bias, 32 - shift);
+				write(ADD, l, bias);
+				write(SAR, l, shift);
+				release(bias);
+			}
+
+			if (divisor < 0) write(NEG, l);
+			push_reg(l, ValueType::INT);
+			return;
+		}
+
+		int multiplier = 0;
+		int shift = 0;
+		signed_magic(divisor, multiplier, shift);
+
+		// one operand IMUL multiplies by EAX and leaves the high half in EDX
+		if (l == Reg::EAX || l == Reg::EDX)
+		{
+			Reg moved = alloc_reg(false, bit(Reg::EAX) | bit(Reg::EDX));
+			write(MOV, moved, l);
+			release(l);
+			l = moved;
+		}
+
+		claim(Reg::EAX, bit(Reg::EAX) | bit(Reg::EDX) | bit(l));
+		claim(Reg::EDX, bit(Reg::EAX) | bit(Reg::EDX) | bit(l));
+
+		write(MOV, Reg::EAX, multiplier);
+		write(IMUL, l);
+		if (divisor > 0 && multiplier < 0) write(ADD, Reg::EDX, l);
+		if (divisor < 0 && multiplier > 0) write(SUB, Reg::EDX, l);
+		if (shift) write(SAR, Reg::EDX, shift);
+		write(MOV, Reg::EAX, Reg::EDX);
+		write(SHR, Reg::EAX, 31);
+		write(ADD, Reg::EDX, Reg::EAX);
+
+		release(Reg::EAX);
+		release(l);
+		push_reg(Reg::EDX, ValueType::INT);
+	}
+
+	void Compiler::int_int_binop(TokenType type, Operand left, Operand right)
 	{
+		// a constant factor is reduced on either side. Divisors of 0 and -1 are left
+		// to IDIV, so INT_MIN / -1 traps whether or not the -1 is a literal
+		if (type == TokenType::MUL && left.kind == Operand::IMM) std::swap(left, right);
+
+		if (right.kind == Operand::IMM && type == TokenType::MUL)
+		{
+			int_mul_imm(left, right.value);
+			return;
+		}
+
+		if (right.kind == Operand::IMM && type == TokenType::DIV && right.value != 0 && right.value != -1)
+		{
+			int_div_imm(left, right.value);
+			return;
+		}
+
+		Reg l = to_reg(left);
+
+		if (type == TokenType::DIV)
+		{
+			// IDIV takes EDX:EAX and leaves the quotient in EAX
+			Reg r = to_reg(right, bit(Reg::EAX) | bit(Reg::EDX));
+			if (r == Reg::EAX || r == Reg::EDX)
+			{
+				Reg moved = alloc_reg(false, bit(Reg::EAX) | bit(Reg::EDX) | bit(l));
+				write(MOV, moved, r);
+				release(r);
+				r = moved;
+			}
+
+			if (l != Reg::EAX)
+			{
+				claim(Reg::EAX, bit(Reg::EAX) | bit(Reg::EDX) | bit(r));
+				write(MOV, Reg::EAX, l);
+				release(l);
+				l = Reg::EAX;
+			}
+
+			claim(Reg::EDX, bit(Reg::EAX) | bit(Reg::EDX) | bit(r));
+			write(CDQ);
+			write(IDIV, r);
+			release(Reg::EDX);
+			release(r);
+			push_reg(l, ValueType::INT);
+			return;
+		}
+
+		InstType inst_type = NO_INST;
 
 		switch (type)
 		{
 		case TokenType::ADD:
-			write(ADD, Reg::EAX, Reg::ECX);
+			inst_type = ADD;
 			break;
 		case TokenType::SUB:
-			write(SUB, Reg::EAX, Reg::ECX);
+			inst_type = SUB;
 			break;
 		case TokenType::MUL:
-			write(MUL, Reg::ECX);
-			break;
-		case TokenType::DIV:
-			write(MOV, Reg::EDX, 0);
-			write(DIV, Reg::ECX);
+			// the low half of MUL and IMUL is the same
+			inst_type = IMUL;
 			break;
 
 		default:
@@ -410,10 +951,19 @@ namespace Chronos
 			exit(-1);
 			break;
 		}
-		write(PUSH, Reg::EAX);
+
+		if (right.kind == Operand::IMM) write(inst_type, l, right.value);
+		else
+		{
+			Reg r = to_reg(right);
+			write(inst_type, l, r);
+			release(r);
+		}
+
+		push_reg(l, ValueType::INT);
 	}
 
-	void Compiler::float_float_binop(TokenType type)
+	void Compiler::float_float_binop(TokenType type, Operand left, Operand right)
 	{
 		InstType inst_type = NO_INST;
 
@@ -433,431 +983,575 @@ namespace Chronos
 			break;
 		}
 
-		write(inst_type, Reg::XMM0, Reg::XMM1);
+		Reg l = to_xmm(left);
+		Reg r = to_xmm(right);
 
-		write(MOVSS, { Reg::ESP, -4, DWORD }, Reg::XMM0);
-		write(SUB, Reg::ESP, 4);
+		write(inst_type, l, r);
+		release(r);
+		push_reg(l, ValueType::FLOAT);
 	}
 
-	void Compiler::eval_arith_binop(Node* node)
+	void Compiler::arith_binop(TokenType op, bool swapped)
 	{
-		ASSERT(node->type == NodeType::BINOP, "expected binop type");
-
-		Node* right = std::get<BinOp>(node->value).right;
-		Node* left = std::get<BinOp>(node->value).left;
+		Operand left, right;
+		pop_operands(swapped, left, right);
 
-		eval_expr(left);
-		eval_expr(right);
+		if (left.type == ValueType::FLOAT || right.type == ValueType::FLOAT) float_float_binop(op, left, right);
+		else int_int_binop(op, left, right);
+	}
 
-		ValueType ltype = left->value_type;
-		ValueType rtype = right->value_type;
+	// AND uses <false, end>, OR uses <true, false, end>
+	uint32_t Compiler::new_label()
+	{
+		uint32_t label = m_CurrentSubLabel;
+		offset_sub_label(1);
+		return label;
+	}
 
-		if (ltype == ValueType::FLOAT && rtype == ValueType::INT)
-		{
-			write(MOVSS, Reg::XMM0, { Reg::ESP, 4, DWORD });
-			write(CVTSI2SS, Reg::XMM1, { Reg::ESP, 0, DWORD });
-			write(ADD, Reg::ESP, 8);
-			float_float_binop(std::get<BinOp>(node->value).type);
-		}
-		else if (ltype == ValueType::INT && rtype == ValueType::FLOAT)
-		{
-			write(CVTSI2SS, Reg::XMM0, { Reg::ESP, 4, DWORD });
-			write(MOVSS, Reg::XMM1, { Reg::ESP, 0, DWORD });
-			write(ADD, Reg::ESP, 8);
-			float_float_binop(std::get<BinOp>(node->value).type);
-		}
-		else if (ltype == ValueType::INT && rtype == ValueType::INT)
-		{
-			write(POP, Reg::ECX);
-			write(POP, Reg::EAX);
-			int_int_binop(std::get<BinOp>(node->value).type);
-		}
-		else if (ltype == ValueType::FLOAT && rtype == ValueType::FLOAT)
-		{
-			write(MOVSS, Reg::XMM0, { Reg::ESP, 4, DWORD });
-			write(MOVSS, Reg::XMM1, { Reg::ESP, 0, DWORD });
-			write(ADD, Reg::ESP, 8);
-			float_float_binop(std::get<BinOp>(node->value).type);
-		}
+	void Compiler::zero_cmp(Reg value)
+	{
+		if (is_xmm(value)) zero_cmp_float(value);
+		else zero_cmp_int(value);
+	}
 
+	// the register of the result is taken before the first jump, both paths write it
+	void Compiler::logic_begin()
+	{
+		push_reg(alloc_reg(false), ValueType::INT);
+		take_snapshot();
 	}
 
-	void Compiler::eval_AND_binop(Node* node)
+	// every jump to 'false_label' and the fall through have the registers of the snapshot,
+	// the fall through is restored here once more in case its last operand did not jump
+	void Compiler::logic_end(uint32_t false_label)
 	{
-		BinOp& binop_val = std::get<BinOp>(node->value);
-		ASSERT(binop_val.type == TokenType::KW_AND, "expected binop type");
+		restore_snapshot();
+		m_Snapshots.pop_back();
 
-		Node* right = binop_val.right;
-		Node* left = binop_val.left;
+		uint32_t end_label = new_label();
+		Reg result = m_Operands.back().reg;
 
-		eval_expr(left);
-		ValueType ltype = left->value_type;
+		write(MOV, result, 1);
+		write(JMP, SubLabel{ end_label });
 
-		if (ltype == ValueType::INT)
-		{
-			zero_cmp_int();
-			write(JE, sub_label(0));
-		}
-		else if (ltype == ValueType::FLOAT)
-		{
-			zero_cmp_float();
-			write(JE, sub_label(0));
-		}
+		write(SubLabel{ false_label });
+		write(MOV, result, 0);
 
-		eval_expr(right);
-		ValueType rtype = right->value_type;
+		write(SubLabel{ end_label });
+	}
 
-		if (rtype == ValueType::INT)
-		{
-			zero_cmp_int();
-			write(JE, sub_label(0));
-		}
-		else if (rtype == ValueType::FLOAT)
+	static bool is_true(int value, ValueType type)
+	{
+		if (type == ValueType::INT) return value != 0;
+
+		float f;
+		std::memcpy(&f, &value, sizeof(f));
+		return !(f == 0.0f || std::isnan(f));
+	}
+
+	// 'value' as 0 or 1, a float is false for NaN like in zero_cmp_float
+	Reg Compiler::bool_reg(Operand value, bool is_bool)
+	{
+		if (value.kind == Operand::IMM)
 		{
-			zero_cmp_float();
-			write(JE, sub_label(0));
+			Reg reg = alloc_reg(false);
+			write(MOV, reg, is_true(value.value, value.type) ? 1 : 0);
+			return reg;
 		}
 
-		write(MOV, Reg::EAX, 1);
-		write(JMP, sub_label(1));
-
-		write(sub_label(0));
-		write(MOV, Reg::EAX, 0);
-		write(sub_label(1));
-		write(PUSH, Reg::EAX);
+		if (is_bool) return to_reg(value);
 
-		offset_sub_label(2);
+		Reg reg = to_reg(value);
+		zero_cmp(reg);
+		release(reg);
 
+		Reg result = alloc_byte_reg(reg);
+		write(SETNE, low_byte(result));
+		write(MOVZX, result, low_byte(result));
+		return result;
 	}
 
-	void Compiler::eval_OR_binop(Node* node)
+	// both operands are short and have no side effects, so they are computed
+	// as 0 or 1 and combined without a jump
+	void Compiler::logic_binop_branchless(TokenType op, bool left_bool, bool right_bool)
 	{
-		BinOp& binop_val = std::get<BinOp>(node->value);
-		ASSERT(binop_val.type == TokenType::KW_OR, "expected binop type");
+		Operand left, right;
+		pop_operands(false, left, right);
 
-		Node* right = std::get<BinOp>(node->value).right;
-		Node* left = std::get<BinOp>(node->value).left;
-
-		eval_expr(left);
-		ValueType ltype = left->value_type;
-
-		if (ltype == ValueType::INT)
-		{
-			zero_cmp_int();
-			write(JNE, sub_label(0));
-		}
-		else if (ltype == ValueType::FLOAT)
-		{
-			zero_cmp_float();
-			write(JNE, sub_label(0));
-		}
+		Reg l = bool_reg(left, left_bool);
+		Reg r = bool_reg(right, right_bool);
 
-		eval_expr(right);
-		ValueType rtype = right->value_type;
+		write(op == TokenType::KW_AND ? AND : OR, l, r);
+		release(r);
+		push_reg(l, ValueType::INT);
+	}
 
-		if (rtype == ValueType::INT)
-		{
-			zero_cmp_int();
-			write(JE, sub_label(1));
-		}
-		else if (rtype == ValueType::FLOAT)
+	Compiler::Condition Compiler::negate(Condition cond)
+	{
+		switch (cond)
 		{
-			zero_cmp_float();
-			write(JE, sub_label(1));
+		case Condition::EQ: return Condition::NE;
+		case Condition::NE: return Condition::EQ;
+		case Condition::L: return Condition::GE;
+		case Condition::LE: return Condition::G;
+		case Condition::G: return Condition::LE;
+		case Condition::GE: return Condition::L;
+		case Condition::A: return Condition::BE;
+		case Condition::AE: return Condition::B;
+		case Condition::B: return Condition::AE;
+		case Condition::BE: return Condition::A;
+		case Condition::ORDERED_EQ: return Condition::UNORDERED_NE;
+		case Condition::UNORDERED_NE: return Condition::ORDERED_EQ;
 		}
 
-		write(sub_label(0));
-		write(MOV, Reg::EAX, 1);
-		write(JMP, sub_label(2));
-
-		write(sub_label(1));
-		write(MOV, Reg::EAX, 0);
+		ASSERT(false, "condition not defined");
+		return cond;
+	}
 
-		write(sub_label(2));
-		write(PUSH, Reg::EAX);
+	// UCOMISS sets CF and ZF like an unsigned compare, and all of ZF, PF and CF when
+	// an operand is NaN. LESS and LESS_EQ compare the other way around so that every
+	// ordering only tests CF/ZF, which NaN leaves failing. EQUAL also needs PF clear
+	Compiler::Condition Compiler::float_float_CMP(TokenType op, Operand left, Operand right)
+	{
+		Reg l = to_xmm(left);
+		Reg r = to_xmm(right);
 
-		offset_sub_label(3);
+		if (op == TokenType::LESS || op == TokenType::LESS_EQ) write(UCOMISS, r, l);
+		else write(UCOMISS, l, r);
 
-	}
+		release(l);
+		release(r);
 
-	void Compiler::float_float_CMP(BinOp& op)
-	{
-		switch (op.type)
+		switch (op)
 		{
 		case TokenType::LESS:
-			write(FLD, { Reg::ESP, 4, DWORD });
-			write(FLD, { Reg::ESP, 0, DWORD });
-			write(FCOMIP, Reg::ST0, Reg::ST1);
-			write(SETA, Reg::AL);
-			break;
-		case TokenType::LESS_EQ:
-			write(FLD, { Reg::ESP, 4, DWORD });
-			write(FLD, { Reg::ESP, 0, DWORD });
-			write(FCOMIP, Reg::ST0, Reg::ST1);
-			write(SETNB, Reg::AL);
-			break;
 		case TokenType::GREATER:
-			write(FLD, { Reg::ESP, 0, DWORD });
-			write(FLD, { Reg::ESP, 4, DWORD });
-			write(FCOMIP, Reg::ST0, Reg::ST1);
-			write(SETA, Reg::AL);
-			break;
+			return Condition::A;
+		case TokenType::LESS_EQ:
 		case TokenType::GREATER_EQ:
-			write(FLD, { Reg::ESP, 0, DWORD });
-			write(FLD, { Reg::ESP, 4, DWORD });
-			write(FCOMIP, Reg::ST0, Reg::ST1);
-			write(SETNB, Reg::AL);
-			break;
+			return Condition::AE;
 		case TokenType::EQUAL:
-			write(FLD, { Reg::ESP, 0, DWORD });
-			write(FLD, { Reg::ESP, 4, DWORD });
-			write(FCOMIP, Reg::ST0, Reg::ST1);
-			write(SETE, Reg::AL);
-			break;
+			return Condition::ORDERED_EQ;
 
 		default:
 			ASSERT(false, "binop type not supported");
+			exit(-1);
 		}
-
-		write(MOVZX, Reg::EAX, Reg::AL);
-		write(ADD, Reg::ESP, 8);
-
-		write(PUSH, Reg::EAX);
 	}
 
-	void Compiler::int_int_CMP(BinOp& op)
+	Compiler::Condition Compiler::int_int_CMP(TokenType op, Operand left, Operand right)
 	{
-		write(MOV, Reg::EAX, { Reg::ESP, 4, DWORD });
-		write(CMP, Reg::EAX, { Reg::ESP, 0, DWORD });
+		Reg l = to_reg(left);
 
-		switch (op.type)
+		if (right.kind == Operand::IMM) write(CMP, l, right.value);
+		else
 		{
-		case TokenType::EQUAL:
-			write(SETE, Reg::AL);
-			break;
-		case TokenType::LESS:
-			write(SETL, Reg::AL);
-			break;
-		case TokenType::LESS_EQ:
-			write(SETLE, Reg::AL);
-			break;
-		case TokenType::GREATER:
-			write(SETG, Reg::AL);
-			break;
-		case TokenType::GREATER_EQ:
-			write(SETGE, Reg::AL);
-			break;
+			Reg r = to_reg(right);
+			write(CMP, l, r);
+			release(r);
+		}
+
+		release(l);
+
+		switch (op)
+		{
+		case TokenType::EQUAL: return Condition::EQ;
+		case TokenType::LESS: return Condition::L;
+		case TokenType::LESS_EQ: return Condition::LE;
+		case TokenType::GREATER: return Condition::G;
+		case TokenType::GREATER_EQ: return Condition::GE;
 		default:
 			ASSERT(false, "binop type not supported");
 			exit(-1);
 		}
-
-		write(MOVZX, Reg::EAX, Reg::AL);
-		write(ADD, Reg::ESP, 8);
-		write(PUSH, Reg::EAX);
 	}
 
-	void Compiler::eval_CMP_binop(Node* node)
+	void Compiler::set_condition(Condition cond)
 	{
-		BinOp& binop_val = std::get<BinOp>(node->value);
-
-		Node* right = binop_val.right;
-		Node* left = binop_val.left;
+		static const InstType SET[] = { SETE, SETNE, SETL, SETLE, SETG, SETGE, SETA, SETNB, SETB, SETBE };
 
-		eval_expr(left);
-		eval_expr(right);
+		Reg result = alloc_byte_reg();
 
-		ValueType ltype = left->value_type;
-		ValueType rtype = right->value_type;
-
-		if (ltype == ValueType::INT && rtype == ValueType::INT)
-		{
-			int_int_CMP(binop_val);
-		}
-		else if (ltype == ValueType::FLOAT && rtype == ValueType::INT)
+		if (cond == Condition::ORDERED_EQ || cond == Condition::UNORDERED_NE)
 		{
-			write(CVTSI2SS, Reg::XMM0, { Reg::ESP, 0, DWORD });
-			write(MOVSS, { Reg::ESP, 0, DWORD }, Reg::XMM0);
-			float_float_CMP(binop_val);
+			bool equal = cond == Condition::ORDERED_EQ;
+			Reg parity = alloc_byte_reg();
+			write(equal ? SETE : SETNE, low_byte(result));
+			write(equal ? SETNP : SETP, low_byte(parity));
+			write(equal ? AND : OR, low_byte(result), low_byte(parity));
+			release(parity);
 		}
-		else if (ltype == ValueType::INT && rtype == ValueType::FLOAT)
+		else write(SET[(size_t) cond], low_byte(result));
+
+		write(MOVZX, result, low_byte(result));
+		push_reg(result, ValueType::INT);
+	}
+
+	void Compiler::jump_condition(Condition cond, uint32_t target)
+	{
+		static const InstType JUMP[] = { JE, JNE, JL, JLE, JG, JGE, JA, JNB, JB, JBE };
+
+		if (cond == Condition::ORDERED_EQ)
 		{
-			write(CVTSI2SS, Reg::XMM0, { Reg::ESP, 4, DWORD });
-			write(MOVSS, { Reg::ESP, 4, DWORD }, Reg::XMM0);
-			float_float_CMP(binop_val);
+			uint32_t unordered = new_label();
+			write(JP, SubLabel{ unordered });
+			write(JE, SubLabel{ target });
+			write(SubLabel{ unordered });
 		}
-		else if (ltype == ValueType::FLOAT && rtype == ValueType::FLOAT)
+		else if (cond == Condition::UNORDERED_NE)
 		{
-			float_float_CMP(binop_val);
+			write(JP, SubLabel{ target });
+			write(JNE, SubLabel{ target });
 		}
+		else write(JUMP[(size_t) cond], SubLabel{ target });
 	}
 
-	void Compiler::eval_binop(Node* node)
+	// 'negate' is set when the compare is the operand of a NOT
+	void Compiler::cmp_binop(TokenType op, bool swapped, bool negate)
 	{
-		ASSERT(node->type == NodeType::BINOP, "expected binop type");
-		BinOp& binop_val = std::get<BinOp>(node->value);
+		Operand left, right;
+		pop_operands(swapped, left, right);
 
-		switch (binop_val.type)
-		{
-		case TokenType::ADD:
-		case TokenType::SUB:
-		case TokenType::MUL:
-		case TokenType::DIV:
-			eval_arith_binop(node);
-			break;
-		case TokenType::KW_AND:
-			eval_AND_binop(node);
-			break;
-		case TokenType::KW_OR:
-			eval_OR_binop(node);
-			break;
-		case TokenType::EQUAL:
-		case TokenType::LESS:
-		case TokenType::LESS_EQ:
-		case TokenType::GREATER:
-		case TokenType::GREATER_EQ:
-			eval_CMP_binop(node);
-			break;
+		Condition cond;
+		if (left.type == ValueType::FLOAT || right.type == ValueType::FLOAT) cond = float_float_CMP(op, left, right);
+		else cond = int_int_CMP(op, left, right);
 
-		default:
-			ASSERT(false, "type of binop not supported");
-			exit(-1);
-		}
+		set_condition(negate ? Compiler::negate(cond) : cond);
 	}
 
-	void Compiler::eval_SUB_unryop(Node* node)
+	// jumps to 'target' when the compare is 'jump_if' and falls through otherwise
+	void Compiler::cmp_jump(TokenType op, bool swapped, uint32_t target, bool jump_if)
 	{
-		ASSERT(node->type == NodeType::UNRYOP, "expected unryop type");
-		UnryOp& unryop_val = std::get<UnryOp>(node->value);
+		Operand left, right;
+		pop_operands(swapped, left, right);
 
-		eval_expr(unryop_val.right);
-		ValueType type = node->value_type;
+		Condition cond;
+		if (left.type == ValueType::FLOAT || right.type == ValueType::FLOAT) cond = float_float_CMP(op, left, right);
+		else cond = int_int_CMP(op, left, right);
 
-		if (type == ValueType::INT)
-		{
-			write(POP, Reg::ECX);
-			write(NEG, Reg::ECX);
-			write(PUSH, Reg::ECX);
-		}
-		else if (type == ValueType::FLOAT)
+		restore_snapshot();
+		jump_condition(jump_if ? cond : negate(cond), target);
+	}
+
+	void Compiler::test_jump(uint32_t target, bool jump_if)
+	{
+		Operand value = pop();
+
+		// an operand that does not jump falls through to the same join, so the
+		// snapshot is put back either way
+		if (value.kind == Operand::IMM)
 		{
-			write(MOVSS, Reg::XMM0, { Reg::ESP, 0, DWORD });
-			write(MOV, Reg::EAX, (int) 0x80000000);
-			write(MOVD, Reg::XMM1, Reg::EAX);
-			write(PXOR, Reg::XMM0, Reg::XMM1);
-			write(MOVSS, { Reg::ESP, 0, DWORD }, Reg::XMM0);
+			restore_snapshot();
+			if (is_true(value.value, value.type) == jump_if) write(JMP, SubLabel{ target });
+			return;
 		}
 
-
-		ASSERT(false, "unryop SUB not defined for this type");
+		Reg reg = to_reg(value);
+		zero_cmp(reg);
+		release(reg);
+		restore_snapshot();
+		write(jump_if ? JNE : JE, SubLabel{ target });
 	}
 
-	void Compiler::eval_NOT_unryop(Node* node)
+	void Compiler::SUB_unryop()
 	{
-		ASSERT(node->type == NodeType::UNRYOP, "expected unryop type");
-		UnryOp& unryop_val = std::get<UnryOp>(node->value);
+		Operand value = pop();
 
-		eval_expr(unryop_val.right);
-		ValueType type = unryop_val.right->value_type;
+		if (value.type == ValueType::INT)
+		{
+			if (value.kind == Operand::IMM)
+			{
+				push_imm((int) (0u - (uint32_t) value.value));
+				return;
+			}
 
-		if (type == ValueType::INT)
+			Reg reg = to_reg(value);
+			write(NEG, reg);
+			push_reg(reg, ValueType::INT);
+		}
+		else if (value.type == ValueType::FLOAT)
 		{
-			zero_cmp_int();
-			write(SETE, Reg::CL);
-			write(MOVZX, Reg::ECX, Reg::CL);
-			write(PUSH, Reg::ECX);
+			if (value.kind == Operand::IMM)
+			{
+				push_imm(value.value ^ (int) 0x80000000, ValueType::FLOAT);
+				return;
+			}
+
+			Reg reg = to_reg(value);
+			Reg bits = alloc_reg(false);
+			Reg sign = alloc_reg(true);
+
+			write(MOV, bits, (int) 0x80000000);
+			write(MOVD, sign, bits);
+			write(PXOR, reg, sign);
+
+			release(bits);
+			release(sign);
+			push_reg(reg, ValueType::FLOAT);
 		}
-		else if (type == ValueType::FLOAT)
+		else
 		{
-			zero_cmp_float();
-			write(SETE, Reg::CL);
-			write(MOVZX, Reg::ECX, Reg::CL);
-			write(PUSH, Reg::ECX);
+			ASSERT(false, "unryop SUB not defined for this type");
+			exit(-1);
 		}
 	}
 
-	void Compiler::eval_unryop(Node* node)
+	void Compiler::NOT_unryop()
 	{
-		ASSERT(node->type == NodeType::UNRYOP, "expected unryop type");
-		UnryOp& unryop_val = std::get<UnryOp>(node->value);
+		Reg value = to_reg(pop());
+		zero_cmp(value);
+		release(value);
+
+		Reg result = alloc_byte_reg(value);
+		write(SETE, low_byte(result));
+		write(MOVZX, result, low_byte(result));
+		push_reg(result, ValueType::INT);
+	}
 
-		switch (unryop_val.type)
+	void Compiler::unryop(TokenType op)
+	{
+		switch (op)
 		{
 		case TokenType::SUB:
-			eval_SUB_unryop(node);
+			SUB_unryop();
 			break;
 		case TokenType::NOT:
-			eval_NOT_unryop(node);
+			NOT_unryop();
 			break;
 
 		default:
 			ASSERT(false, "type of unryop not supported");
 			exit(-1);
 		}
-
 	}
 
-	void Compiler::eval_assing(Node* node)
+	// the value stays pending, it is the result of the ASSIGN
+	void Compiler::assign(uint32_t symbol)
 	{
-		ASSERT(node->type == NodeType::ASSIGN, "expected unryop type");
-		AssignOp& op = std::get<AssignOp>(node->value);
-
-		eval_expr(op.expr);
-		ValueType type = node->value_type;
+		int offset = (*m_Symbols)[symbol].offset;
+		if (offset == Symbol::NO_SLOT) return;
 
-		m_VarTable.insert({ op.var, StackVal { m_BPOffset, type } });
-		write(MOV, Reg::EAX, { Reg::ESP, 0, DWORD });
-		write(MOV, { Reg::EBP, -m_BPOffset, DWORD }, Reg::EAX);
-		m_BPOffset += 4;
+		if (m_Operands.back().kind == Operand::IMM)
+		{
+			write_imm(MOV, { Reg::EBP, -offset, DWORD }, m_Operands.back());
+			return;
+		}
 
+		Operand value = pop();
+		Reg reg = to_reg(value);
+		write(is_xmm(reg) ? MOVSS : MOV, { Reg::EBP, -offset, DWORD }, reg);
+		push_reg(reg, value.type);
 	}
 
-	void Compiler::eval_access(std::string var)
+	void Compiler::eval_access(uint32_t symbol)
 	{
-		if (m_VarTable.find(var) != m_VarTable.end())
-		{
-			write(PUSH, { Reg::EBP, -m_VarTable.at(var).offset, DWORD });
-		}
+		const Symbol& var = (*m_Symbols)[symbol];
+		bool xmm = var.type == ValueType::FLOAT;
 
+		Reg reg = alloc_reg(xmm);
+		write(xmm ? MOVSS : MOV, reg, { Reg::EBP, -var.offset, DWORD });
+		push_reg(reg, var.type);
 	}
 
-	void Compiler::eval_expr(Node* node)
+	void Compiler::eval_expr(FlatAST& ast)
 	{
-		if (!node) return;
-
-		switch (node->type)
+		auto is_logic = [&](uint32_t i)
+		{
+			return ast.kinds[i] == NodeType::BINOP && (ast.ops[i] == TokenType::KW_AND || ast.ops[i] == TokenType::KW_OR);
+		};
+		auto is_cmp = [&](uint32_t i)
+		{
+			return ast.kinds[i] == NodeType::BINOP && TypeChecker::is_logic_op(ast.ops[i]) && !is_logic(i);
+		};
+		auto is_not = [&](uint32_t i)
+		{
+			return ast.kinds[i] == NodeType::UNRYOP && ast.ops[i] == TokenType::NOT;
+		};
+		auto is_leaf = [&](uint32_t i)
+		{
+			return ast.kinds[i] == NodeType::NUM || ast.kinds[i] == NodeType::ACCESS;
+		};
+		// cheap enough to compute even when the AND/OR would not need it
+		auto is_short = [&](uint32_t i)
+		{
+			if (is_leaf(i)) return true;
+			if (is_not(i)) return is_leaf(ast.lhs[i]);
+			return is_cmp(i) && is_leaf(ast.lhs[i]) && is_leaf(ast.rhs[i]);
+		};
+
+		// Sethi-Ullman numbers, a BINOP without side effects below it computes
+		// the operand that needs more registers first
+		std::vector<uint32_t> need(ast.size());
+		std::vector<bool> pure(ast.size());
+		std::vector<bool> swapped(ast.size(), false);
+		// a compare under a NOT sets the opposite condition and the NOT emits nothing
+		std::vector<bool> negated(ast.size(), false);
+
+		for (uint32_t i = 0; i < ast.size(); i++)
 		{
-		case NodeType::ROOT:
-			for (Node* n : std::get<Root>(node->value).nodes)
+			uint32_t l = ast.lhs[i], r = ast.rhs[i];
+
+			switch (ast.kinds[i])
 			{
-				eval_expr(n);
-				print_value(n->value_type);
+			case NodeType::NUM:
+			case NodeType::ACCESS:
+				need[i] = 1;
+				pure[i] = true;
+				break;
+			case NodeType::ASSIGN:
+				need[i] = need[l];
+				pure[i] = false;
+				break;
+			case NodeType::UNRYOP:
+				need[i] = need[l];
+				pure[i] = pure[l];
+				if (is_not(i) && is_cmp(l)) negated[l] = true;
+				break;
+			case NodeType::BINOP:
+				need[i] = need[l] == need[r] ? need[l] + 1 : std::max(need[l], need[r]);
+				pure[i] = pure[l] && pure[r];
+				swapped[i] = !is_logic(i) && pure[i] && need[r] > need[l];
+				break;
+			case NodeType::ROOT:
+				ASSERT(false, "ROOT node in a flat AST");
+				break;
 			}
-			break;
+		}
 
-		case NodeType::NUM:
-			eval_num(std::get<Token>(node->value));
-			break;
-		case NodeType::BINOP:
-			eval_binop(node);
-			break;
-		case NodeType::UNRYOP:
-			eval_unryop(node);
-			break;
-		case NodeType::ASSIGN:
-			eval_assing(node);
-			break;
-		case NodeType::ACCESS:
-			eval_access(std::get<std::string>(node->value));
-			break;
+		// an AND/OR, and a NOT or compare below one, is lowered to jumps: COND jumps
+		// to 'label' when the node is 'jump_if' and falls through otherwise
+		enum class Step : uint8_t { VISIT, EMIT, COND, CMP_JUMP, TEST_JUMP, LABEL, LOGIC_END };
+		struct Work
+		{
+			uint32_t node;
+			Step step;
+			uint32_t label = 0;
+			bool jump_if = false;
+		};
+		std::vector<Work> steps;
+
+		for (uint32_t statement : ast.statements)
+		{
+			steps.push_back({ statement, Step::VISIT });
 
-		default:
-			ASSERT(false, "not implemented yet");
-			break;
+			while (!steps.empty())
+			{
+				Work work = steps.back();
+				steps.pop_back();
+
+				uint32_t i = work.node;
+				TokenType op = ast.ops[i];
+
+				switch (work.step)
+				{
+				case Step::VISIT:
+					if (is_logic(i) && !(is_short(ast.lhs[i]) && is_short(ast.rhs[i])))
+					{
+						uint32_t false_label = new_label();
+						logic_begin();
+						steps.push_back({ i, Step::LOGIC_END, false_label });
+						steps.push_back({ i, Step::COND, false_label, false });
+						continue;
+					}
+
+					steps.push_back({ i, Step::EMIT });
+					if (ast.kinds[i] != NodeType::BINOP)
+					{
+						if (ast.lhs[i] != FlatAST::NO_NODE) steps.push_back({ ast.lhs[i], Step::VISIT });
+					}
+					else
+					{
+						steps.push_back({ swapped[i] ? ast.lhs[i] : ast.rhs[i], Step::VISIT });
+						steps.push_back({ swapped[i] ? ast.rhs[i] : ast.lhs[i], Step::VISIT });
+					}
+					continue;
+
+				case Step::COND:
+					if (is_logic(i))
+					{
+						// AND jumps when an operand is false, OR when one is true, the
+						// other way the left operand skips the test of the right one
+						bool falls_through = (op == TokenType::KW_AND) != work.jump_if;
+						if (falls_through)
+						{
+							steps.push_back({ ast.rhs[i], Step::COND, work.label, work.jump_if });
+							steps.push_back({ ast.lhs[i], Step::COND, work.label, work.jump_if });
+						}
+						else
+						{
+							uint32_t skip = new_label();
+							steps.push_back({ i, Step::LABEL, skip });
+							steps.push_back({ ast.rhs[i], Step::COND, work.label, work.jump_if });
+							steps.push_back({ ast.lhs[i], Step::COND, skip, !work.jump_if });
+						}
+					}
+					else if (is_not(i)) steps.push_back({ ast.lhs[i], Step::COND, work.label, !work.jump_if });
+					else if (is_cmp(i))
+					{
+						steps.push_back({ i, Step::CMP_JUMP, work.label, work.jump_if });
+						steps.push_back({ swapped[i] ? ast.lhs[i] : ast.rhs[i], Step::VISIT });
+						steps.push_back({ swapped[i] ? ast.rhs[i] : ast.lhs[i], Step::VISIT });
+					}
+					else
+					{
+						steps.push_back({ i, Step::TEST_JUMP, work.label, work.jump_if });
+						steps.push_back({ i, Step::VISIT });
+					}
+					continue;
+
+				case Step::CMP_JUMP:
+					cmp_jump(op, swapped[i], work.label, work.jump_if);
+					continue;
+				case Step::TEST_JUMP:
+					test_jump(work.label, work.jump_if);
+					continue;
+				case Step::LABEL:
+					write(SubLabel{ work.label });
+					continue;
+				case Step::LOGIC_END:
+					logic_end(work.label);
+					continue;
+				case Step::EMIT:
+					break;
+				}
+
+				switch (ast.kinds[i])
+				{
+				case NodeType::NUM:
+				{
+					Token t(op, ast.values[i], ast.spans[i]);
+					eval_num(t);
+					break;
+				}
+				case NodeType::BINOP:
+				{
+					uint32_t l = ast.lhs[i], r = ast.rhs[i];
+					if (is_logic(i)) logic_binop_branchless(op, !is_leaf(l), !is_leaf(r));
+					else if (is_cmp(i)) cmp_binop(op, swapped[i], negated[i]);
+					else arith_binop(op, swapped[i]);
+					break;
+				}
+				case NodeType::UNRYOP:
+					if (!(is_not(i) && negated[ast.lhs[i]])) unryop(op);
+					break;
+				case NodeType::ASSIGN:
+					assign(ast.values[i].symbol);
+					break;
+				case NodeType::ACCESS:
+					eval_access(ast.values[i].symbol);
+					break;
+
+				default:
+					ASSERT(false, "not implemented yet");
+					break;
+				}
+			}
+
+			print_value(ast.types[statement]);
 		}
 	}
 
-	void Compiler::compile(const char* name, Node* root)
+	void Compiler::write_prologue(const char* name, uint32_t alloc_size)
 	{
 		m_Name = name;
 
@@ -865,9 +1559,6 @@ namespace Chronos
 		file_name += ".asm";
 		m_Output = std::ofstream(file_name.c_str());
 
-		TypeChecker checker;
-		checker.check_type(root);
-
 		set_label("");
 		write(GLOBAL, "main");
 		write(EXTERN, "printf");
@@ -889,18 +1580,78 @@ namespace Chronos
 		write(AND, Reg::ESP, -8);
 		write(PUSH, Reg::EBP);
 		write(MOV, Reg::EBP, Reg::ESP);
-		write(SUB, Reg::ESP, (int) checker.get_alloc_size());
+		write(SUB, Reg::ESP, (int) alloc_size);
+		m_FrameInst = m_Code.at("main").size() - 1;
 
 		write(CALL, "alloc_heap");
 		write(MOV, { "heap_ptr", 0, DWORD }, Reg::EAX);
+	}
 
-		eval_expr(root);
-
+	void Compiler::write_epilogue()
+	{
 		write(MOV, Reg::ESP, Reg::EBP);
 		write(POP, Reg::EBP);
 		write(MOV, Reg::EAX, 1);
 		write(MOV, Reg::EBX, 1);
 		write(INT, 0x80);
+	}
+
+	// the tree is lowered through its flat form, which needs no recursion
+	void Compiler::compile(const char* name, Node* root)
+	{
+		FlatAST ast = flatten(root);
+
+		TypeChecker checker;
+		checker.check_type(ast);
+		fold_constants(ast, checker.get_symbols());
+		eliminate_common_subexpressions(ast, checker.get_symbols());
+		layout_frame(ast, checker.get_symbols());
+		compile(name, ast, checker.get_symbols());
+	}
+
+	void Compiler::compile(const char* name, FlatAST& ast, const SymbolTable& symbols)
+	{
+		m_Symbols = &symbols;
+		write_prologue(name, symbols.frame_size());
+		reset_registers(symbols.frame_size());
+		eval_expr(ast);
+		reserve_frame(symbols.frame_size());
+		write_epilogue();
+	}
 
+	void Compiler::begin(const char* name)
+	{
+		m_Checker = TypeChecker();
+		m_Symbols = &m_Checker.get_symbols();
+		write_prologue(name, 0);
+	}
+
+	void Compiler::compile_statement(Node* node)
+	{
+		FlatAST ast = flatten(node);
+
+		uint32_t alloc_before = m_Checker.get_alloc_size();
+		m_Checker.check_type(ast);
+
+		// nothing is known about the variables of earlier lines, only what the
+		// statement computes from its own literals and stores is folded
+		fold_constants(ast, m_Checker.get_symbols());
+
+		// slots of new variables and the spill slots of the statement are reserved
+		// right before it, the spill slots are dead once it is done
+		uint32_t alloc_size = m_Checker.get_alloc_size() - alloc_before;
+		write(SUB, Reg::ESP, (int) alloc_size);
+		m_FrameInst = m_Code.at("main").size() - 1;
+
+		reset_registers(m_Checker.get_alloc_size());
+		eval_expr(ast);
+
+		if (alloc_size || m_MaxSpills) reserve_frame(alloc_size);
+		else m_Code.at("main").erase(m_Code.at("main").begin() + m_FrameInst);
+	}
+
+	void Compiler::end()
+	{
+		write_epilogue();
 	}
 }
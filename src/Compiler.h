@@ -8,6 +8,12 @@
 #include "Parser.h"
 #include "Debug.h"
 #include "TypeChecker.h"
+#include "FlatAST.h"
+#include "FrameLayout.h"
+#include "ConstantFolding.h"
+#include "CommonSubexpressions.h"
+#include "Assembly.h"
+#include "Peephole.h"
 
 #define HEADER_SIZE 4
 #define PTR_SIZE 4
@@ -15,160 +21,72 @@
 namespace Chronos
 {
 
-	namespace x86ASM
-	{
-		using Label = const char*;
-		struct SubLabel
-		{
-			uint32_t count = 0;
-		};
-
-		enum Section : uint8_t
-		{
-			DATA = 0,
-			BSS,
-			TEXT,
-			NO_SECTION,
-		};
-
-		enum InstType : uint16_t
-		{
-			#define INST_TYPE(a) a,
-			#define REGISTER(a)
-			#include "x86ASM.h"
-		};
-
-		enum class Reg : uint8_t
-		{
-			#define INST_TYPE(a)
-			#define REGISTER(a) a,
-			#include "x86ASM.h"
-		};
-
-		enum DerefSize : uint8_t
-		{
-			BYTE = 0,
-			WORD,
-			DWORD,
-			QWORD,
-			NO_DEREF,
-		};
-
-		enum ReserveSize : uint8_t
-		{
-			RESB = 0,
-			RESW,
-			RESQ,
-			NO_RESERVE,
-		};
-
-		enum DefineSize : uint8_t
-		{
-			DB = 0,
-			DW,
-			DQ,
-			NO_DEFINE,
-		};
-
-		enum MemAdressType
-		{
-			REGISTER = 0,
-			LABEL_ADR,
-			SUB_LABEL_ADR,
-		};
-
-		using MemAdress = std::variant<Reg, const char*, SubLabel>;
-
-		struct MemAccess
-		{
-			MemAdress adress = Reg::NO_REG;
-			int offset = 0;
-			DerefSize size = NO_DEREF;
-
-			MemAccess(const char* adr)
-				: adress(adr) {}
-			MemAccess(SubLabel l)
-				: adress(l) {}
-			MemAccess(Reg reg)
-				: adress(reg) {}
-			MemAccess(Reg reg, int off)
-				: adress(reg), offset(off) {}
-			MemAccess(const char* adr, int off)
-				: adress(adr), offset(off) {}
-			MemAccess(Reg reg, int off, DerefSize s)
-				: adress(reg), offset(off), size(s) {}
-			MemAccess(const char* reg, int off, DerefSize s)
-				: adress(reg), offset(off), size(s) {}
-		};
-
-		struct ReserveMem
-		{
-			const char* name;
-			ReserveSize size = NO_RESERVE;
-			int count;
-		};
-
+	std::string to_string(std::unordered_map<x86ASM::Label, std::vector<x86ASM::Instruction>>& m_Code);
+	using ASMCode = std::unordered_map<x86ASM::Label, std::vector<x86ASM::Instruction>>;
 
-		struct DefineMem
-		{
-			const char* name;
-			DefineSize size = NO_DEFINE;
-			std::vector<std::variant<const char*, int>> bytes;
-		};
+	class Compiler
+	{
+	private:
+		const char* m_Name = "";
 
+		x86ASM::Label m_CurrentLabel = "";
+		ASMCode m_Code;
 
-		static const int MEM_ACCESS = 0;
-		static const int INT_VALUE = 1;
-		static const int FLOAT_VALUE = 2;
-		static const int NO_ADR = 3;
+		// slots and types of the symbols the ACCESS/ASSIGN nodes were resolved to
+		const SymbolTable* m_Symbols = nullptr;
+		uint32_t m_CurrentSubLabel = 0;
 
-		struct BasicInst
+		// a value waiting for its parent, the operands of a node are on top
+		struct Operand
 		{
-			InstType type;
-			std::variant<MemAccess, int, float, bool> adresses[2] = { false, false };
+			enum Kind : uint8_t { IMM, REG, SPILL };
 
+			Kind kind;
+			ValueType type;
+			x86ASM::Reg reg = x86ASM::Reg::NO_REG;
+			int value = 0;		// constant of IMM, frame offset of SPILL
 		};
 
-		enum InstructionType : uint8_t
-		{
-			BASIC_INST = 0,
-			RESERVE_MEM,
-			DEFINE_MEM,
-			SECTION,
-			SUB_LABEL,
-		};
+		// what the flags of a compare have to show for it to hold, the float
+		// equalities also look at PF, which UCOMISS sets for NaN
+		enum class Condition : uint8_t { EQ, NE, L, LE, G, GE, A, AE, B, BE, ORDERED_EQ, UNORDERED_NE };
 
-		using Instruction = std::variant<BasicInst, ReserveMem, DefineMem, Section, SubLabel>;
-	}
+		static constexpr uint32_t REG_FREE = UINT32_MAX;
+		static constexpr uint32_t REG_BUSY = UINT32_MAX - 1;
 
-	std::string to_string(std::unordered_map<x86ASM::Label, std::vector<x86ASM::Instruction>>& m_Code);
-	using ASMCode = std::unordered_map<x86ASM::Label, std::vector<x86ASM::Instruction>>;
+		std::vector<Operand> m_Operands;
+		// index in m_Operands of the value a register holds, REG_FREE, or REG_BUSY
+		// while an instruction being emitted uses it
+		uint32_t m_RegOwner[(size_t) x86ASM::Reg::NO_REG + 1];
 
-	struct StackVal
-	{
-		int offset;
-		ValueType type;
-	};
+		// spilled values live in slots below the variables of the frame
+		uint32_t m_SpillBase = 0;
+		uint32_t m_SpillCount = 0;
+		uint32_t m_MaxSpills = 0;
+		std::vector<int> m_FreeSpills;
 
-	class Compiler
-	{
-	private:
-		const char* m_Name = "";
+		// registers of the values pending when an AND/OR started, they hold the
+		// same values again at every jump out of its operands
+		std::vector<std::vector<std::pair<uint32_t, x86ASM::Reg>>> m_Snapshots;
 
-		x86ASM::Label m_CurrentLabel = "";
-		ASMCode m_Code;
+		// the SUB ESP that reserves the frame, patched once the spill slots are known
+		size_t m_FrameInst = 0;
 
-		std::unordered_map<std::string, StackVal> m_VarTable; //<name, offset>
-		int m_BPOffset = 4;
-		uint32_t m_CurrentSubLabel = 0;
+		Peephole m_Peephole;
+		bool m_UsePeephole = true;
+		bool m_PeepholeDone = false;
 
 		std::ofstream m_Output;
 
+		// only used between begin() and end()
+		TypeChecker m_Checker;
+
 		void set_label(x86ASM::Label l) { m_CurrentLabel = l; }
 		x86ASM::SubLabel sub_label();
 		x86ASM::SubLabel sub_label(uint32_t offset); 
 		void offset_sub_label(uint32_t offset); 
 		void write(x86ASM::Instruction i);
+		void write(x86ASM::InstType t);
 		void write(x86ASM::InstType t, x86ASM::MemAccess a);
 		void write(x86ASM::InstType t, x86ASM::MemAccess a, x86ASM::MemAccess b);
 		void write(x86ASM::InstType t, x86ASM::MemAccess a, int b);
@@ -179,35 +97,88 @@ namespace Chronos
 		void write_mem_def(const char* var, x86ASM::DefineSize size, std::vector<std::variant<const char*, int>> bytes);
 		void write_mem_res(const char* var, x86ASM::ReserveSize size, int count);
 
-		void zero_cmp_float();
-		void zero_cmp_int();
+		void reset_registers(uint32_t spill_base);
+		x86ASM::Reg alloc_reg(bool xmm, uint64_t exclude = 0, x86ASM::Reg prefer = x86ASM::Reg::NO_REG);
+		x86ASM::Reg alloc_byte_reg(x86ASM::Reg prefer = x86ASM::Reg::NO_REG);
+		void release(x86ASM::Reg reg);
+		int spill_slot();
+		void free_spill(int offset);
+		void spill(uint32_t operand);
+		void claim(x86ASM::Reg reg, uint64_t exclude);
+		void push_reg(x86ASM::Reg reg, ValueType type);
+		void push_imm(int value, ValueType type = ValueType::INT);
+		void write_imm(x86ASM::InstType t, x86ASM::MemAccess a, const Operand& imm);
+		Operand pop();
+		void pop_operands(bool swapped, Operand& left, Operand& right);
+		x86ASM::Reg to_reg(Operand value, uint64_t exclude = 0);
+		x86ASM::Reg to_xmm(Operand value);
+		void take_snapshot();
+		void restore_snapshot();
+		void reserve_frame(uint32_t size);
+
+		void zero_cmp_float(x86ASM::Reg value);
+		void zero_cmp_int(x86ASM::Reg value);
+		void zero_cmp(x86ASM::Reg value);
 
 		void print_top();
 		void print_chint();
 		void print_value(ValueType type);
 
+		void write_prologue(const char* name, uint32_t alloc_size);
+		void write_epilogue();
+
+		// emit the code for one node once its operands are in m_Operands, 'swapped'
+		// means the right operand was computed first
+		void int_mul_imm(Operand left, int factor);
+		void int_div_imm(Operand left, int divisor);
+		void int_int_binop(TokenType type, Operand left, Operand right);
+		void float_float_binop(TokenType type, Operand left, Operand right);
+		void arith_binop(TokenType op, bool swapped);
+		uint32_t new_label();
+		void logic_begin();
+		void logic_end(uint32_t false_label);
+		x86ASM::Reg bool_reg(Operand value, bool is_bool);
+		void logic_binop_branchless(TokenType op, bool left_bool, bool right_bool);
+		static Condition negate(Condition cond);
+		Condition float_float_CMP(TokenType op, Operand left, Operand right);
+		Condition int_int_CMP(TokenType op, Operand left, Operand right);
+		void set_condition(Condition cond);
+		void jump_condition(Condition cond, uint32_t target);
+		void cmp_binop(TokenType op, bool swapped, bool negate);
+		void cmp_jump(TokenType op, bool swapped, uint32_t target, bool jump_if);
+		void test_jump(uint32_t target, bool jump_if);
+		void SUB_unryop();
+		void NOT_unryop();
+		void unryop(TokenType op);
+		void assign(uint32_t symbol);
+
 		void eval_num(Token& token);
-		void int_int_binop(TokenType type);
-		void float_float_binop(TokenType type);
-		void eval_arith_binop(Node* node);
-		void eval_AND_binop(Node* node);
-		void eval_OR_binop(Node* node);
-		void float_float_CMP(NodeValues::BinOp& op);
-		void int_int_CMP(NodeValues::BinOp& op);
-		void eval_CMP_binop(Node* node);
-		void eval_binop(Node* node);
-		void eval_SUB_unryop(Node* node);
-		void eval_NOT_unryop(Node* node);
-		void eval_unryop(Node* node);
-		void eval_assing(Node* node);
-		void eval_expr(Node* node);
-		void eval_access(std::string var);
+		void eval_expr(FlatAST& ast);
+		void eval_access(uint32_t symbol);
 
 
 	public:
 		void compile(const char* name, Node* node);
+		// 'ast' has to be type checked already, 'symbols' is the table of that checker
+		void compile(const char* name, FlatAST& ast, const SymbolTable& symbols);
+
+		// compiles a program one statement at a time, the symbols, labels and
+		// code emitted so far are kept between calls to compile_statement
+		void begin(const char* name);
+		void compile_statement(Node* node);
+		void end();
+
+		void set_peephole(bool enabled) { m_UsePeephole = enabled; }
+		// rewrites the code emitted so far, close() does it unless it already ran
+		// or is turned off. Returns the number of rewrites
+		size_t peephole();
+		std::vector<std::pair<const char*, size_t>> peephole_hits() const { return m_Peephole.get_hits(); }
+
 		void close();
 
+		// instructions emitted so far and not yet written out by close()
+		size_t instruction_count() const;
+
 		~Compiler()
 		{
 			close();
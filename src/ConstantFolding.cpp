@@ -0,0 +1,237 @@
+#include "ConstantFolding.h"
+
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+namespace Chronos
+{
+	// a literal as the generated code computes it
+	struct Constant
+	{
+		ValueType type = ValueType::NONE;
+		TokenValue value = 0;
+
+		float as_float() const { return type == ValueType::FLOAT ? value.float_value : (float) value.int_value; }
+
+		// zero_cmp_int/zero_cmp_float, UCOMISS also reports NaN as equal to zero
+		bool is_true() const
+		{
+			if (type == ValueType::INT) return value.int_value != 0;
+			return !(value.float_value == 0.0f || std::isnan(value.float_value));
+		}
+	};
+
+	static Constant int_constant(int v) { return { ValueType::INT, v }; }
+	static Constant bool_constant(bool v) { return int_constant(v ? 1 : 0); }
+
+	static std::optional<Constant> float_constant(float v)
+	{
+		// non-finite values can't be written as an immediate
+		if (!std::isfinite(v)) return std::nullopt;
+		return Constant { ValueType::FLOAT, v };
+	}
+
+	static bool is_cmp_op(TokenType op)
+	{
+		return op == TokenType::EQUAL || op == TokenType::LESS || op == TokenType::LESS_EQ || op == TokenType::GREATER || op == TokenType::GREATER_EQ;
+	}
+
+	static bool is_number(const Constant& c)
+	{
+		return c.type == ValueType::INT || c.type == ValueType::FLOAT;
+	}
+
+	// int_int_binop: wrapping ADD/SUB/MUL and a signed DIV that truncates, the
+	// divisions IDIV traps on are left to do so at run time
+	static std::optional<Constant> fold_int_arith(TokenType op, int left, int right)
+	{
+		uint32_t l = (uint32_t) left;
+		uint32_t r = (uint32_t) right;
+
+		switch (op)
+		{
+		case TokenType::ADD: return int_constant((int) (l + r));
+		case TokenType::SUB: return int_constant((int) (l - r));
+		case TokenType::MUL: return int_constant((int) (l * r));
+		case TokenType::DIV:
+			if (right == 0 || (left == INT32_MIN && right == -1)) return std::nullopt;
+			return int_constant(left / right);
+		default: return std::nullopt;
+		}
+	}
+
+	// float_float_binop, ints are converted with CVTSI2SS first
+	static std::optional<Constant> fold_float_arith(TokenType op, float left, float right)
+	{
+		switch (op)
+		{
+		case TokenType::ADD: return float_constant(left + right);
+		case TokenType::SUB: return float_constant(left - right);
+		case TokenType::MUL: return float_constant(left * right);
+		case TokenType::DIV: return float_constant(left / right);
+		default: return std::nullopt;
+		}
+	}
+
+	// int_int_CMP compares signed, float_float_CMP on floats (NaN is never folded)
+	template<typename T>
+	static std::optional<Constant> fold_cmp(TokenType op, T left, T right)
+	{
+		switch (op)
+		{
+		case TokenType::EQUAL: return bool_constant(left == right);
+		case TokenType::LESS: return bool_constant(left < right);
+		case TokenType::LESS_EQ: return bool_constant(left <= right);
+		case TokenType::GREATER: return bool_constant(left > right);
+		case TokenType::GREATER_EQ: return bool_constant(left >= right);
+		default: return std::nullopt;
+		}
+	}
+
+	static std::optional<Constant> fold_binop(TokenType op, const Constant& left, const Constant& right)
+	{
+		if (!is_number(left) || !is_number(right)) return std::nullopt;
+
+		switch (op)
+		{
+		case TokenType::KW_AND: return bool_constant(left.is_true() && right.is_true());
+		case TokenType::KW_OR: return bool_constant(left.is_true() || right.is_true());
+		default: break;
+		}
+
+		bool ints = left.type == ValueType::INT && right.type == ValueType::INT;
+
+		if (is_cmp_op(op))
+		{
+			if (ints) return fold_cmp(op, left.value.int_value, right.value.int_value);
+			return fold_cmp(op, left.as_float(), right.as_float());
+		}
+
+		if (ints) return fold_int_arith(op, left.value.int_value, right.value.int_value);
+		return fold_float_arith(op, left.as_float(), right.as_float());
+	}
+
+	static std::optional<Constant> fold_unryop(TokenType op, const Constant& operand)
+	{
+		if (!is_number(operand)) return std::nullopt;
+
+		switch (op)
+		{
+		case TokenType::NOT: return bool_constant(!operand.is_true());
+		case TokenType::SUB:
+			if (operand.type == ValueType::INT) return int_constant((int) (0u - (uint32_t) operand.value.int_value));
+			return float_constant(-operand.value.float_value);
+		default: return std::nullopt;
+		}
+	}
+
+	static std::optional<Constant> constant_of(const FlatAST& ast, uint32_t index)
+	{
+		if (ast.kinds[index] != NodeType::NUM) return std::nullopt;
+		return Constant { ast.types[index], ast.values[index] };
+	}
+
+	static void make_literal(FlatAST& ast, uint32_t index, const Constant& c)
+	{
+		ast.kinds[index] = NodeType::NUM;
+		ast.ops[index] = c.type == ValueType::INT ? TokenType::INT : TokenType::FLOAT;
+		ast.values[index] = c.value;
+		ast.types[index] = c.type;
+		ast.lhs[index] = FlatAST::NO_NODE;
+		ast.rhs[index] = FlatAST::NO_NODE;
+	}
+
+	// keeps the nodes reachable from a statement, in the same order
+	static void remove_dead_nodes(FlatAST& ast)
+	{
+		std::vector<bool> live(ast.size(), false);
+		for (uint32_t statement : ast.statements) live[statement] = true;
+
+		// operands come before their node, so one backward pass marks everything
+		for (uint32_t i = ast.size(); i > 0; i--)
+		{
+			uint32_t index = i - 1;
+			if (!live[index]) continue;
+			if (ast.lhs[index] != FlatAST::NO_NODE) live[ast.lhs[index]] = true;
+			if (ast.rhs[index] != FlatAST::NO_NODE) live[ast.rhs[index]] = true;
+		}
+
+		std::vector<uint32_t> moved_to(ast.size(), FlatAST::NO_NODE);
+		FlatAST compact;
+
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			if (!live[i]) continue;
+
+			uint32_t left = ast.lhs[i] == FlatAST::NO_NODE ? FlatAST::NO_NODE : moved_to[ast.lhs[i]];
+			uint32_t right = ast.rhs[i] == FlatAST::NO_NODE ? FlatAST::NO_NODE : moved_to[ast.rhs[i]];
+			moved_to[i] = compact.add(ast.kinds[i], ast.ops[i], left, right, ast.values[i], ast.types[i], ast.spans[i]);
+		}
+
+		for (uint32_t statement : ast.statements) compact.statements.push_back(moved_to[statement]);
+		ast = std::move(compact);
+	}
+
+	void fold_constants(FlatAST& ast, const SymbolTable& symbols)
+	{
+		// right operands of AND/OR may be skipped at runtime, assignments in
+		// there leave the variable unknown afterwards
+		std::vector<uint32_t> first(ast.size());
+		std::vector<int> conditional(ast.size() + 1, 0);
+
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			first[i] = ast.lhs[i] == FlatAST::NO_NODE ? i : first[ast.lhs[i]];
+
+			bool logic = ast.ops[i] == TokenType::KW_AND || ast.ops[i] == TokenType::KW_OR;
+			if (ast.kinds[i] == NodeType::BINOP && logic)
+			{
+				conditional[first[ast.rhs[i]]]++;
+				conditional[ast.rhs[i] + 1]--;
+			}
+		}
+
+		std::vector<std::optional<Constant>> known(symbols.size());
+		int depth = 0;
+
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			depth += conditional[i];
+			std::optional<Constant> result;
+
+			switch (ast.kinds[i])
+			{
+			case NodeType::BINOP:
+			{
+				std::optional<Constant> left = constant_of(ast, ast.lhs[i]);
+				std::optional<Constant> right = constant_of(ast, ast.rhs[i]);
+				if (left && right) result = fold_binop(ast.ops[i], *left, *right);
+				break;
+			}
+			case NodeType::UNRYOP:
+			{
+				std::optional<Constant> operand = constant_of(ast, ast.lhs[i]);
+				if (operand) result = fold_unryop(ast.ops[i], *operand);
+				break;
+			}
+			case NodeType::ACCESS:
+				result = known[ast.values[i].symbol];
+				break;
+			case NodeType::ASSIGN:
+				// the store stays, only later reads are replaced
+				if (depth == 0) known[ast.values[i].symbol] = constant_of(ast, ast.lhs[i]);
+				else known[ast.values[i].symbol] = std::nullopt;
+				break;
+			default:
+				// a NUM is already a literal, flatten never keeps a ROOT
+				break;
+			}
+
+			// the checker's type has to stay, a fold never changes how the value is kept
+			if (result && result->type == ast.types[i]) make_literal(ast, i, *result);
+		}
+
+		remove_dead_nodes(ast);
+	}
+}
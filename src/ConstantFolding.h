@@ -0,0 +1,16 @@
+#pragma once
+
+#include "FlatAST.h"
+#include "SymbolTable.h"
+
+namespace Chronos
+{
+	// evaluates operators whose operands are all literals at compile time and
+	// replaces reads of variables that hold a known literal, then drops the nodes
+	// that are no longer referenced. Results are exactly what the generated code
+	// would compute, anything that can't be reproduced that way (division by zero,
+	// NaN and infinite floats, pointers) is left for runtime. 'ast' has to be type
+	// checked with 'symbols', variables stored before it are treated as unknown, so
+	// a single REPL statement can be folded on its own
+	void fold_constants(FlatAST& ast, const SymbolTable& symbols);
+}
@@ -1,4 +1,17 @@
+#include <algorithm>
+
 #include "Error.h"
+#include "CharClass.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Chronos
 {
@@ -20,9 +33,8 @@ namespace Chronos
 	std::string Error::generate_message(std::vector<File>& files)
 	{
 		std::string message = "";
-		std::string file_name = files[start_pos.file_nr].name;
 		message += error_to_string(type) + ": " + details + "\n";
-		message += get_error_preview(start_pos.file_nr, files);
+		message += get_error_preview(span.file_nr, files);
 
 		return message;
 	}
@@ -31,32 +43,136 @@ namespace Chronos
 	{
 		std::string res = "";
 		auto& file = files[file_nr];
-		auto& text = file.text;
-
-		int start = text.substr(0, start_pos.index).rfind("\n");
-		if (start == std::string::npos) start = 0;
-		int end = text.substr(start + 1).find("\n");
-		if (end == std::string::npos) end= text.size() - start + 1;
-		end += start + 1;
 
-		int count = end_pos.line - start_pos.line + 1;
+		Position start = file.get_position(span.begin);
+		Position end = file.get_position(span.end());
 
-		for (int i = 0; i < count; i++)
+		for (std::size_t line = start.line; line <= end.line; line++)
 		{
-			 std::string line = text.substr(start, end);
-			 int col_start = 0;
-			 if (i == 0) col_start = start_pos.column;
-			 int col_end = line.size() - 1;
-			 if (i == count - 1) col_end = end_pos.column;
-
-			 res += line + "\n";
-			 res += std::string(col_start, ' ');
-			 res += std::string(col_end - col_start, '~');
-
-			 start = end;
-			 end = text.substr(0, start).find('\n');
-			 if (end == std::string::npos) end = text.size();
+			std::string_view text = file.get_line(line);
+
+			std::size_t col_start = 0;
+			if (line == start.line) col_start = start.column;
+			std::size_t col_end = text.size();
+			if (line == end.line) col_end = end.column;
+			if (col_end <= col_start) col_end = col_start + 1;
+
+			if (line != start.line) res += "\n";
+			res += std::string(text) + "\n";
+			res += std::string(col_start, ' ');
+			res += std::string(col_end - col_start, '~');
 		}
 		return res;
 	}
+
+	Position File::get_position(uint32_t offset) const
+	{
+		if (line_starts.empty())
+		{
+			std::string_view text = view();
+			line_starts.push_back(0);
+			for_each_newline(text.data(), text.size(), [&](std::size_t i) { line_starts.push_back((uint32_t) i + 1); });
+		}
+
+		auto it = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+		std::size_t line = (it - line_starts.begin()) - 1;
+
+		return Position { offset, line, offset - line_starts[line] };
+	}
+
+	std::string_view File::get_line(std::size_t line) const
+	{
+		std::string_view text = view();
+		std::size_t start = line_starts[line];
+		std::size_t end = line + 1 < line_starts.size() ? line_starts[line + 1] - 1 : text.size();
+		if (end > start && text[end - 1] == '\r') --end;
+		return text.substr(start, end - start);
+	}
+
+#ifdef _WIN32
+	bool MappedFile::map(const std::string& path)
+	{
+		unmap();
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		// an empty file can't be mapped, but it is still a valid (empty) source
+		if (size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			m_Data = "";
+			m_Size = 0;
+			return true;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!mapping) return false;
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!data) return false;
+
+		m_Data = (const char*) data;
+		m_Size = (std::size_t) size.QuadPart;
+		return true;
+	}
+
+	void MappedFile::unmap()
+	{
+		if (m_Data && m_Size) UnmapViewOfFile(m_Data);
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+#else
+	bool MappedFile::map(const std::string& path)
+	{
+		unmap();
+
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		// an empty file can't be mapped, but it is still a valid (empty) source
+		if (info.st_size == 0)
+		{
+			::close(fd);
+			m_Data = "";
+			m_Size = 0;
+			return true;
+		}
+
+		void* data = mmap(nullptr, (std::size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED) return false;
+
+		// the lexer scans front to back exactly once
+		madvise(data, (std::size_t) info.st_size, MADV_SEQUENTIAL);
+
+		m_Data = (const char*) data;
+		m_Size = (std::size_t) info.st_size;
+		return true;
+	}
+
+	void MappedFile::unmap()
+	{
+		if (m_Data && m_Size) munmap((void*) m_Data, m_Size);
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+#endif
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
 
 #include "Debug.h"
@@ -8,20 +10,96 @@
 
 namespace Chronos
 {
+	// source range of a token or node, line and column are only computed
+	// from it when a message needs them
+	struct Span
+	{
+		uint32_t file_nr = 0;
+		uint32_t begin = 0;
+		uint32_t length = 0;
+
+		uint32_t end() const { return begin + length; }
+	};
+
+	// span covering everything from the start of 'a' to the end of 'b'
+	inline Span span_between(const Span& a, const Span& b)
+	{
+		return { a.file_nr, a.begin, b.end() - a.begin };
+	}
+
 	struct Position
 	{
 		std::size_t index = 0;
 		std::size_t line = 0;
 		std::size_t column = 0;
+	};
+
+	// read-only view of a file mapped into memory, unmapped on destruction
+	class MappedFile
+	{
+	private:
+		const char* m_Data = nullptr;
+		std::size_t m_Size = 0;
+
+		void unmap();
+
+	public:
+		MappedFile() {}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& other) noexcept
+			: m_Data(other.m_Data), m_Size(other.m_Size)
+		{
+			other.m_Data = nullptr;
+			other.m_Size = 0;
+		}
+
+		MappedFile& operator=(MappedFile&& other) noexcept
+		{
+			if (this != &other)
+			{
+				unmap();
+				m_Data = other.m_Data;
+				m_Size = other.m_Size;
+				other.m_Data = nullptr;
+				other.m_Size = 0;
+			}
+			return *this;
+		}
 
-		std::size_t file_nr = 0;
-		std::size_t offset = 0;
+		~MappedFile()
+		{
+			unmap();
+		}
+
+		bool map(const std::string& path);
+		bool is_mapped() const { return m_Data != nullptr; }
+
+		const char* data() const { return m_Data; }
+		std::size_t size() const { return m_Size; }
 	};
 
 	struct File
 	{
 		std::string name;
 		std::string text;
+		MappedFile mapping;
+
+		// offsets of the first character of every line, built on first use
+		mutable std::vector<uint32_t> line_starts;
+
+		File(std::string name, std::string text)
+			: name(std::move(name)), text(std::move(text)) {}
+
+		std::string_view view() const
+		{
+			if (mapping.is_mapped()) return { mapping.data(), mapping.size() };
+			return text;
+		}
+
+		Position get_position(uint32_t offset) const;
+		std::string_view get_line(std::size_t line) const;
 	};
 
 	class FileManager
@@ -40,9 +118,21 @@ namespace Chronos
 
 		void add_file(std::string name, std::string text)
 		{
-			File file = { name, text };
-			m_Files.push_back(file);
+			File file(std::move(name), std::move(text));
+			m_Files.push_back(std::move(file));
+			m_CurrentLine = 0;
+		}
+
+		// maps the file at 'path' instead of reading it into memory,
+		// returns false if it can't be opened
+		bool map_file(const std::string& path)
+		{
+			File file(path, "");
+			if (!file.mapping.map(path)) return false;
+
+			m_Files.push_back(std::move(file));
 			m_CurrentLine = 0;
+			return true;
 		}
 
 		std::vector<File>& get_files()
@@ -60,6 +150,7 @@ namespace Chronos
 			{
 				File& last = m_Files.front();
 				last.text += line;
+				last.line_starts.clear();
 				++m_CurrentLine;
 			}
 		}
@@ -83,8 +174,7 @@ namespace Chronos
 		ErrorType type = ErrorType::NONE;
 		std::string details;
 
-		Position start_pos;
-		Position end_pos;
+		Span span;
 
 		std::string generate_message(std::vector<File>& files);
 		std::string get_error_preview(std::size_t file_nr, std::vector<File>& files);
@@ -0,0 +1,111 @@
+#include "FlatAST.h"
+
+namespace Chronos
+{
+	using namespace NodeValues;
+
+	uint32_t FlatAST::add(NodeType kind, TokenType op, uint32_t left, uint32_t right, TokenValue value, ValueType type, Span span)
+	{
+		kinds.push_back(kind);
+		ops.push_back(op);
+		lhs.push_back(left);
+		rhs.push_back(right);
+		values.push_back(value);
+		types.push_back(type);
+		spans.push_back(span);
+		return size() - 1;
+	}
+
+	void FlatAST::clear()
+	{
+		kinds.clear();
+		ops.clear();
+		lhs.clear();
+		rhs.clear();
+		values.clear();
+		types.clear();
+		spans.clear();
+		statements.clear();
+	}
+
+	uint32_t FlatAST::first_of(uint32_t index) const
+	{
+		while (lhs[index] != NO_NODE) index = lhs[index];
+		return index;
+	}
+
+	// pops the indices of the 'count' operands pushed last, in source order
+	static void pop_operands(std::vector<uint32_t>& done, uint32_t* out, size_t count)
+	{
+		for (size_t i = count; i > 0; i--)
+		{
+			out[i - 1] = done.back();
+			done.pop_back();
+		}
+	}
+
+	static void add_node(FlatAST& ast, Node* node, std::vector<uint32_t>& done)
+	{
+		uint32_t operands[2] = { FlatAST::NO_NODE, FlatAST::NO_NODE };
+		uint32_t index = FlatAST::NO_NODE;
+
+		switch (node->type)
+		{
+		case NodeType::NUM:
+		{
+			Token& t = std::get<Token>(node->value);
+			index = ast.add(NodeType::NUM, t.type, FlatAST::NO_NODE, FlatAST::NO_NODE, t.value, node->value_type, node->span);
+			break;
+		}
+		case NodeType::ACCESS:
+			index = ast.add(NodeType::ACCESS, TokenType::ID, FlatAST::NO_NODE, FlatAST::NO_NODE, std::get<SymbolID>(node->value), node->value_type, node->span);
+			break;
+		case NodeType::ASSIGN:
+			pop_operands(done, operands, 1);
+			index = ast.add(NodeType::ASSIGN, TokenType::ASSIGN, operands[0], FlatAST::NO_NODE, std::get<AssignOp>(node->value).var, node->value_type, node->span);
+			break;
+		case NodeType::UNRYOP:
+			pop_operands(done, operands, 1);
+			index = ast.add(NodeType::UNRYOP, std::get<UnryOp>(node->value).type, operands[0], FlatAST::NO_NODE, 0, node->value_type, node->span);
+			break;
+		case NodeType::BINOP:
+			pop_operands(done, operands, 2);
+			index = ast.add(NodeType::BINOP, std::get<BinOp>(node->value).type, operands[0], operands[1], 0, node->value_type, node->span);
+			break;
+
+		default:
+			ASSERT(false, "node type can not be flattened");
+			exit(-1);
+		}
+
+		done.push_back(index);
+	}
+
+	FlatAST flatten(Node* root)
+	{
+		FlatAST ast;
+		if (!root) return ast;
+
+		std::vector<Node*> statements;
+		if (root->type == NodeType::ROOT)
+		{
+			for (Node* n : std::get<Root>(root->value).nodes)
+			{
+				if (n) statements.push_back(n);
+			}
+		}
+		else statements.push_back(root);
+
+		std::vector<uint32_t> done;
+
+		for (Node* statement : statements)
+		{
+			for_each_post_order(statement, [&ast, &done](Node* node) { add_node(ast, node, done); });
+
+			ast.statements.push_back(done.back());
+			done.pop_back();
+		}
+
+		return ast;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Parser.h"
+
+namespace Chronos
+{
+	// the Node tree laid out as parallel arrays in post-order, every node comes
+	// after its operands so type checking and codegen are a single forward loop
+	// over contiguous memory. Children are referenced by index instead of pointer
+	struct FlatAST
+	{
+		static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+		std::vector<NodeType> kinds;
+		std::vector<TokenType> ops;		// operator of BINOP/UNRYOP, literal type of NUM
+		std::vector<uint32_t> lhs;		// left of BINOP, operand of UNRYOP/ASSIGN
+		std::vector<uint32_t> rhs;		// right of BINOP
+		std::vector<TokenValue> values;	// literal of NUM, name of ACCESS/ASSIGN, their symbol index once type checked
+		std::vector<ValueType> types;
+		std::vector<Span> spans;
+
+		// index of the last node of every top-level statement, in order
+		std::vector<uint32_t> statements;
+
+		uint32_t size() const { return (uint32_t) kinds.size(); }
+
+		uint32_t add(NodeType kind, TokenType op, uint32_t left, uint32_t right, TokenValue value, ValueType type, Span span);
+		void clear();
+
+		// index of the first node of the subtree that ends at 'index'
+		uint32_t first_of(uint32_t index) const;
+	};
+
+	// builds the flat form of a ROOT node or a single expression
+	FlatAST flatten(Node* root);
+}
@@ -0,0 +1,89 @@
+#include "FrameLayout.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+namespace Chronos
+{
+	void layout_frame(const FlatAST& ast, SymbolTable& symbols)
+	{
+		static const uint32_t NO_NODE = FlatAST::NO_NODE;
+
+		// a symbol is live from the first store to it up to its last use, the
+		// program has no loops, so node order is execution order. Stores after
+		// the last read are still emitted, so they keep the slot as well
+		std::vector<uint32_t> first_store(symbols.size(), NO_NODE);
+		std::vector<uint32_t> last_use(symbols.size(), NO_NODE);
+		std::vector<bool> kept(symbols.size(), false);
+
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			if (ast.kinds[i] != NodeType::ASSIGN && ast.kinds[i] != NodeType::ACCESS) continue;
+
+			uint32_t symbol = ast.values[i].symbol;
+			if (first_store[symbol] == NO_NODE) first_store[symbol] = i;
+			if (ast.kinds[i] == NodeType::ACCESS) kept[symbol] = true;
+			last_use[symbol] = i;
+		}
+
+		// the last symbol of a name holds the variable when the program ends, a
+		// script's variables are its result, so their final stores stay even if
+		// nothing reads them and their slots are never handed on
+		std::unordered_map<SymbolID, uint32_t> final_symbol;
+		for (uint32_t symbol = 0; symbol < symbols.size(); symbol++)
+		{
+			SymbolID name = symbols[symbol].name;
+			if (name == Symbol::NO_NAME || first_store[symbol] == NO_NODE) continue;
+
+			auto it = final_symbol.find(name);
+			if (it == final_symbol.end()) final_symbol.emplace(name, symbol);
+			else if (first_store[symbol] > first_store[it->second]) it->second = symbol;
+		}
+
+		for (auto& [name, symbol] : final_symbol)
+		{
+			kept[symbol] = true;
+			last_use[symbol] = ast.size();
+		}
+
+		// a linear scan over the intervals by the start of their range, symbols
+		// made by later passes (like the temporaries of CSE) can start anywhere
+		std::vector<uint32_t> order;
+		for (uint32_t symbol = 0; symbol < symbols.size(); symbol++)
+		{
+			if (kept[symbol]) order.push_back(symbol);
+			else symbols.set_offset(symbol, Symbol::NO_SLOT);
+		}
+
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return first_store[a] < first_store[b]; });
+
+		using Active = std::pair<uint32_t, int>; // <last use, offset>
+		std::priority_queue<Active, std::vector<Active>, std::greater<Active>> active;
+		std::vector<int> free_slots;
+		int slot_count = 0;
+
+		for (uint32_t symbol : order)
+		{
+			while (!active.empty() && active.top().first < first_store[symbol])
+			{
+				free_slots.push_back(active.top().second);
+				active.pop();
+			}
+
+			int offset = 0;
+			if (free_slots.empty()) offset = 4 * ++slot_count;
+			else
+			{
+				offset = free_slots.back();
+				free_slots.pop_back();
+			}
+
+			symbols.set_offset(symbol, offset);
+			active.push({ last_use[symbol], offset });
+		}
+
+		symbols.set_frame_size(4 * slot_count);
+	}
+}
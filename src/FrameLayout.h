@@ -0,0 +1,14 @@
+#pragma once
+
+#include "FlatAST.h"
+#include "SymbolTable.h"
+
+namespace Chronos
+{
+	// replaces the one slot per symbol of the type checker with a minimal frame,
+	// symbols whose live ranges don't overlap share a slot and symbols that are
+	// never read get none, except the final symbol of every variable, which keeps
+	// its value after the program. 'ast' has to be type checked with 'symbols' and
+	// contain the whole program, later statements could still read a freed slot
+	void layout_frame(const FlatAST& ast, SymbolTable& symbols);
+}
@@ -0,0 +1,216 @@
+#include "IncrementalLexer.h"
+
+#include <algorithm>
+
+namespace Chronos
+{
+	Token IncrementalLexer::absolute(Cursor at) const
+	{
+		const Chunk& chunk = m_Chunks[at.chunk];
+		Token token = chunk.tokens[at.index];
+		token.begin = chunk.base + token.begin;
+		return token;
+	}
+
+	// a token before the edit can still grow into it, so the search is for the
+	// first one that ends at or after 'offset'
+	IncrementalLexer::Cursor IncrementalLexer::first_ending_at(size_t offset) const
+	{
+		auto ends_before = [offset](const Chunk& chunk, const Token& token)
+		{
+			return (size_t) (uint32_t) (chunk.base + token.begin) + token.length < offset;
+		};
+
+		auto chunk = std::partition_point(m_Chunks.begin(), m_Chunks.end(),
+			[&](const Chunk& c) { return ends_before(c, c.tokens.back()); });
+		if (chunk == m_Chunks.end()) return { m_Chunks.size(), 0 };
+
+		auto token = std::partition_point(chunk->tokens.begin(), chunk->tokens.end(),
+			[&](const Token& t) { return ends_before(*chunk, t); });
+		return { (size_t) (chunk - m_Chunks.begin()), (size_t) (token - chunk->tokens.begin()) };
+	}
+
+	void IncrementalLexer::next(Cursor& at) const
+	{
+		if (++at.index < m_Chunks[at.chunk].tokens.size()) return;
+
+		at.chunk++;
+		at.index = 0;
+	}
+
+	void IncrementalLexer::append(Token token)
+	{
+		if (m_Chunks.empty() || m_Chunks.back().tokens.size() >= CHUNK_TOKENS)
+		{
+			m_Chunks.emplace_back();
+			m_Chunks.back().base = token.begin;
+		}
+
+		Chunk& chunk = m_Chunks.back();
+		token.begin -= chunk.base;
+		chunk.tokens.push_back(token);
+		m_TokenCount++;
+	}
+
+	// moves everything past the first CHUNK_TOKENS into chunks of its own
+	void IncrementalLexer::split(size_t chunk)
+	{
+		std::vector<Chunk> parts;
+
+		std::vector<Token>& tokens = m_Chunks[chunk].tokens;
+		uint32_t base = m_Chunks[chunk].base;
+
+		for (size_t i = CHUNK_TOKENS; i < tokens.size(); i += CHUNK_TOKENS)
+		{
+			Chunk part;
+			part.base = base + tokens[i].begin;
+
+			size_t end = std::min(i + CHUNK_TOKENS, tokens.size());
+			for (size_t j = i; j < end; j++)
+			{
+				Token token = tokens[j];
+				token.begin = base + token.begin - part.base;
+				part.tokens.push_back(token);
+			}
+
+			parts.push_back(std::move(part));
+		}
+
+		tokens.resize(CHUNK_TOKENS);
+		m_Chunks.insert(m_Chunks.begin() + chunk + 1, std::make_move_iterator(parts.begin()), std::make_move_iterator(parts.end()));
+	}
+
+	void IncrementalLexer::load_text(const char* text, size_t size, size_t file_nr)
+	{
+		m_Chunks.clear();
+		m_TokenCount = 0;
+		m_FileNr = file_nr;
+
+		m_Lexer.clear();
+		m_Lexer.load_text(text, size, file_nr);
+		while (std::optional<Token> token = m_Lexer.next_token()) append(*token);
+
+		m_HasError = m_Lexer.has_error();
+		m_Error = m_Lexer.get_error();
+	}
+
+	void IncrementalLexer::relex(const char* text, size_t size, const TextEdit& edit)
+	{
+		// the old stream stopped early, there is nothing after the error to reuse
+		if (m_HasError)
+		{
+			load_text(text, size, m_FileNr);
+			return;
+		}
+
+		int64_t delta = (int64_t) edit.inserted.size() - (int64_t) edit.removed;
+		size_t edit_end = edit.offset + edit.removed;
+
+		Cursor first = first_ending_at(edit.offset);
+		Cursor end = { m_Chunks.size(), 0 };
+
+		size_t restart = edit.offset;
+		if (first.chunk < m_Chunks.size()) restart = std::min(restart, (size_t) absolute(first).begin);
+
+		m_Lexer.load_text(text, size, m_FileNr);
+		m_Lexer.seek(restart);
+
+		std::vector<Token> relexed;
+		Cursor old = first;
+		Cursor resync = end;
+
+		while (std::optional<Token> token = m_Lexer.next_token())
+		{
+			while (old.chunk < end.chunk && (int64_t) absolute(old).begin + delta < (int64_t) token->begin) next(old);
+
+			if (old.chunk < end.chunk && absolute(old).begin >= edit_end)
+			{
+				Token moved = absolute(old);
+				moved.begin = (uint32_t) (moved.begin + delta);
+
+				if (same_token(moved, *token))
+				{
+					resync = old;
+					break;
+				}
+			}
+
+			relexed.push_back(*token);
+		}
+
+		m_HasError = m_Lexer.has_error();
+		m_Error = m_Lexer.get_error();
+
+		// the edit is past the last token, the new ones simply follow
+		if (first.chunk == end.chunk)
+		{
+			for (const Token& token : relexed) append(token);
+			return;
+		}
+
+		// the old tokens [first, resync) are replaced by 'relexed', which go into
+		// the chunk of 'first'. The rest moves by 'delta', the tail of that chunk
+		// one token at a time and every later chunk by its base
+		Chunk& head = m_Chunks[first.chunk];
+		std::vector<Token> tail;
+
+		if (resync.chunk == first.chunk)
+		{
+			for (size_t i = resync.index; i < head.tokens.size(); i++)
+			{
+				Token token = head.tokens[i];
+				token.begin = (uint32_t) (token.begin + delta);
+				tail.push_back(token);
+			}
+
+			m_TokenCount -= resync.index - first.index;
+		}
+		else
+		{
+			m_TokenCount -= head.tokens.size() - first.index;
+			for (size_t c = first.chunk + 1; c < resync.chunk; c++) m_TokenCount -= m_Chunks[c].tokens.size();
+
+			if (resync.chunk < m_Chunks.size())
+			{
+				std::vector<Token>& tokens = m_Chunks[resync.chunk].tokens;
+				tokens.erase(tokens.begin(), tokens.begin() + resync.index);
+				m_TokenCount -= resync.index;
+			}
+		}
+
+		if (resync.chunk > first.chunk + 1)
+		{
+			m_Chunks.erase(m_Chunks.begin() + first.chunk + 1, m_Chunks.begin() + resync.chunk);
+		}
+
+		for (size_t c = first.chunk + 1; c < m_Chunks.size(); c++) m_Chunks[c].base = (uint32_t) (m_Chunks[c].base + delta);
+
+		head.tokens.resize(first.index);
+		for (Token token : relexed)
+		{
+			token.begin -= head.base;
+			head.tokens.push_back(token);
+		}
+		head.tokens.insert(head.tokens.end(), tail.begin(), tail.end());
+		m_TokenCount += relexed.size();
+
+		if (head.tokens.empty()) m_Chunks.erase(m_Chunks.begin() + first.chunk);
+		else if (head.tokens.size() >= 2 * CHUNK_TOKENS) split(first.chunk);
+	}
+
+	std::deque<Token> IncrementalLexer::get_tokens() const
+	{
+		std::deque<Token> tokens;
+
+		for (const Chunk& chunk : m_Chunks)
+		{
+			for (Token token : chunk.tokens)
+			{
+				token.begin = chunk.base + token.begin;
+				tokens.push_back(token);
+			}
+		}
+
+		return tokens;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Lexer.h"
+
+namespace Chronos
+{
+	// keeps the tokens of one buffer up to date while it is edited, for an editor
+	// that sends the buffer on every keystroke. Tokens live in chunks and their
+	// offsets are relative to the base of their chunk, so an edit rewrites the
+	// tokens it lexes again and moves the bases of the chunks after it, never
+	// the tokens in them
+	class IncrementalLexer
+	{
+	private:
+		struct Chunk
+		{
+			uint32_t base = 0;
+			std::vector<Token> tokens;	// 'begin' is relative to 'base'
+		};
+
+		// a token by its chunk and its index in there
+		struct Cursor
+		{
+			size_t chunk = 0;
+			size_t index = 0;
+		};
+
+		// new chunks get this many tokens, a chunk that grows to twice as many is split
+		static const size_t CHUNK_TOKENS = 512;
+
+		Lexer m_Lexer;
+		std::vector<Chunk> m_Chunks;	// never holds an empty chunk
+		size_t m_TokenCount = 0;
+		size_t m_FileNr = 0;
+
+		Error m_Error;
+		bool m_HasError = false;
+
+		Token absolute(Cursor at) const;
+		Cursor first_ending_at(size_t offset) const;
+		void next(Cursor& at) const;
+
+		void append(Token token);
+		void split(size_t chunk);
+
+	public:
+		IncrementalLexer(StringTable& strings)
+			: m_Lexer(strings) {}
+
+		// lexes all of 'text'
+		void load_text(const char* text, size_t size, size_t file_nr = 0);
+
+		// 'text' already has 'edit' applied and the tokens are still those of the
+		// text before it. Only the tokens touched by the edit are lexed again, as
+		// soon as a new token lines up with an old one (moved by the edit) the
+		// rest of the old stream is kept
+		void relex(const char* text, size_t size, const TextEdit& edit);
+
+		size_t size() const { return m_TokenCount; }
+
+		// the whole stream with absolute offsets, as the Parser takes it
+		std::deque<Token> get_tokens() const;
+
+		bool has_error() const { return m_HasError; }
+		Error get_error() const { return m_Error; }
+	};
+}
@@ -0,0 +1,62 @@
+#include "MemoryStats.h"
+
+// the replacement of the global allocator is only built with CHRONOS_MEMORY_STATS,
+// without it the counters only see the blocks of the Arena
+#ifdef CHRONOS_MEMORY_STATS
+
+#include <cstdlib>
+#include <new>
+
+// every allocation carries its size in front of it so delete can count it,
+// the header keeps the default alignment of operator new
+static const size_t HEADER = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+static void* counted_alloc(size_t size)
+{
+	char* block = (char*) std::malloc(size + HEADER);
+	if (!block) return nullptr;
+
+	*(size_t*) block = size;
+	Chronos::MemoryStats::on_alloc(size);
+	return block + HEADER;
+}
+
+static void counted_free(void* ptr)
+{
+	if (!ptr) return;
+
+	char* block = (char*) ptr - HEADER;
+	Chronos::MemoryStats::on_free(*(size_t*) block);
+	std::free(block);
+}
+
+void* operator new(size_t size)
+{
+	void* ptr = counted_alloc(size ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_alloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_alloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { counted_free(ptr); }
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace Chronos
+{
+	// process wide heap counters, fed by the Arena's blocks and, when built with
+	// CHRONOS_MEMORY_STATS, by the global operator new/delete in MemoryStats.cpp
+	struct MemoryStats
+	{
+		// without the counting allocator the numbers leave out most of the heap
+#ifdef CHRONOS_MEMORY_STATS
+		static constexpr bool COUNTS_HEAP = true;
+#else
+		static constexpr bool COUNTS_HEAP = false;
+#endif
+
+		static inline std::atomic<size_t> allocations = 0;
+		static inline std::atomic<size_t> bytes = 0;
+		static inline std::atomic<size_t> peak_bytes = 0;
+
+		static void on_alloc(size_t size)
+		{
+			allocations.fetch_add(1, std::memory_order_relaxed);
+			size_t now = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+			size_t peak = peak_bytes.load(std::memory_order_relaxed);
+			while (now > peak && !peak_bytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+		}
+
+		static void on_free(size_t size)
+		{
+			bytes.fetch_sub(size, std::memory_order_relaxed);
+		}
+
+		// starts a new peak measurement from the bytes in use right now
+		static void reset_peak()
+		{
+			peak_bytes.store(bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	};
+}
@@ -1,6 +1,6 @@
 #include <iostream>
 #include <algorithm>
-#include <stack>
+#include <array>
 
 #include "Parser.h"
 
@@ -8,6 +8,43 @@ namespace Chronos
 {
 	using namespace NodeValues;
 
+	enum class Assoc : uint8_t
+	{
+		LEFT,
+		RIGHT,
+	};
+
+	struct BinopInfo
+	{
+		uint8_t precedence = 0; // 0 if the token is not a binary operator
+		Assoc assoc = Assoc::LEFT;
+	};
+
+	constexpr std::array<BinopInfo, (size_t) TokenType::NONE + 1> make_binop_table()
+	{
+		std::array<BinopInfo, (size_t) TokenType::NONE + 1> table = {};
+
+		table[(size_t) TokenType::KW_AND] = { 1, Assoc::LEFT };
+		table[(size_t) TokenType::KW_OR] = { 1, Assoc::LEFT };
+
+		table[(size_t) TokenType::EQUAL] = { 2, Assoc::LEFT };
+		table[(size_t) TokenType::LESS] = { 2, Assoc::LEFT };
+		table[(size_t) TokenType::GREATER] = { 2, Assoc::LEFT };
+		table[(size_t) TokenType::LESS_EQ] = { 2, Assoc::LEFT };
+		table[(size_t) TokenType::GREATER_EQ] = { 2, Assoc::LEFT };
+
+		table[(size_t) TokenType::ADD] = { 3, Assoc::LEFT };
+		table[(size_t) TokenType::SUB] = { 3, Assoc::LEFT };
+
+		table[(size_t) TokenType::MUL] = { 4, Assoc::LEFT };
+		table[(size_t) TokenType::DIV] = { 4, Assoc::LEFT };
+
+		return table;
+	}
+
+	// precedence climbing table, indexed by TokenType
+	constexpr std::array<BinopInfo, (size_t) TokenType::NONE + 1> BINOP_TABLE = make_binop_table();
+
 	void print_tokens(const std::deque<Token>& tokens)
 	{
 		std::cout << "\n";
@@ -19,119 +56,123 @@ namespace Chronos
 		std::cout << "\n";
 	}
 
-	void delete_nodes(Node* root)
+	Node* make_root(Arena& arena)
+	{
+		return arena.make<Node>(Node { NodeType::ROOT, Root { NodeList(ArenaAllocator<Node*>(arena)) }, Span {} });
+	}
+
+	// walks the tree with an explicit stack of nodes still to print and text
+	// that goes after them, so deep trees don't overflow the native stack
+	std::string to_string(const Node& n, const StringTable& strings)
 	{
-		if (!root) return; 
+		struct Part
+		{
+			const Node* node = nullptr;
+			std::string text;
+		};
 
-		std::stack<Node*> nodes;
-		nodes.push(root);
+		std::string s;
+		std::vector<Part> stack = { { &n, "" } };
 
-		while (!nodes.empty())
+		while (!stack.empty())
 		{
-			Node* n = nodes.top();
-			nodes.pop();
+			Part part = std::move(stack.back());
+			stack.pop_back();
 
-			switch (n->type)
+			if (!part.node)
 			{
-			case NodeType::ROOT:
-				for (Node* node : std::get<Root>(n->value).nodes) nodes.push(node);
-				break;
+				s += part.text;
+				continue;
+			}
 
-			case NodeType::NUM:
-				break;
+			const Node& node = *part.node;
 
-			case NodeType::UNRYOP:
-				nodes.push(std::get<UnryOp>(n->value).right);
-				break;
+#ifdef PRINT_POS
+			stack.push_back({ nullptr, " " + to_string(node.span) });
+#endif
 
+			// pushed in reverse, the last part is printed first
+			switch (node.type)
+			{
+			case NodeType::NUM:
+				s += "NUM(" + to_string(std::get<Token>(node.value)) + ")";
+				break;
 			case NodeType::BINOP:
-				nodes.push(std::get<BinOp>(n->value).right);
-				nodes.push(std::get<BinOp>(n->value).left);
+				stack.push_back({ nullptr, ")" });
+				stack.push_back({ std::get<BinOp>(node.value).right, "" });
+				stack.push_back({ nullptr, ", " + to_string(std::get<BinOp>(node.value).type) + ", " });
+				stack.push_back({ std::get<BinOp>(node.value).left, "" });
+				s += "BINOP(";
+				break;
+			case NodeType::UNRYOP:
+				stack.push_back({ nullptr, ")" });
+				stack.push_back({ std::get<UnryOp>(node.value).right, "" });
+				s += "UNRYOP(" + to_string(std::get<UnryOp>(node.value).type) + ", ";
 				break;
-
 			case NodeType::ASSIGN:
-				nodes.push(std::get<AssignOp>(n->value).expr);
+				stack.push_back({ nullptr, ")" });
+				stack.push_back({ std::get<AssignOp>(node.value).expr, "" });
+				s += "ASSIGN(" + std::string(strings.get(std::get<AssignOp>(node.value).var)) + ", ";
 				break;
-
 			case NodeType::ACCESS:
+				s += "ACCESS(" + std::string(strings.get(std::get<SymbolID>(node.value))) + ")";
 				break;
 
 			default:
-				ASSERT(false, "delete for this type not defined");
+				ASSERT(false, "to_string not defined for this NodeType");
 				exit(-1);
 			}
-
-			delete n;
 		}
+
+		return s;
 	}
 
-	std::string to_string(const Node& n)
+	Node* Parser::make_node(Node node)
 	{
-		std::string s;
-
-		switch (n.type)
-		{
-		case NodeType::NUM:
-			s += "NUM(";
-			s += to_string(std::get<Token>(n.value));
-			s += ")";
-			break;
-		case NodeType::BINOP:
-			s += "BINOP(";
-			s += to_string(*std::get<BinOp>(n.value).left);
-			s += ", " + to_string(std::get<BinOp>(n.value).type) + ", ";
-			s += to_string(*std::get<BinOp>(n.value).right);
-			s += ")";
-			break;
-		case NodeType::UNRYOP:
-			s += "UNRYOP(";
-			s += to_string(std::get<UnryOp>(n.value).type) + ", ";
-			s += to_string(*std::get<UnryOp>(n.value).right);
-			s += ")";
-			break;
-		case NodeType::ASSIGN:
-			s += "ASSIGN(";
-			s += std::get<AssignOp>(n.value).var + ", ";
-			s += to_string(*std::get<AssignOp>(n.value).expr);
-			s += ")";
-			break;
-		case NodeType::ACCESS:
-			s += "ACCESS(";
-			s += std::get<std::string>(n.value);
-			s += ")";
-			break;
+		return m_Arena->make<Node>(std::move(node));
+	}
 
-		default:
-			ASSERT(false, "to_string not defined for this NodeType");
-			exit(-1);
+	Token Parser::fetch()
+	{
+		std::optional<Token> token;
 
+		if (m_Lexer)
+		{
+			token = m_Lexer->next_token();
+		}
+		else if (!m_Tokens.empty())
+		{
+			token = m_Tokens.front();
+			m_Tokens.pop_front();
 		}
 
-#ifdef PRINT_POS
-		s += " start: " + to_string(n.start_pos);
-		s += ", end: " + to_string(n.end_pos);
-#endif
+		if (!token) return Token(TokenType::NONE, { 0 }, { m_LastSpan.file_nr, m_LastSpan.end(), 0 });
 
-		return s;
+		m_LastSpan = token->span();
+		return *token;
 	}
 
-	void Parser::advance()
+	void Parser::reset_lookahead()
 	{
-		++m_TokenIndex;
+		m_LookaheadStart = 0;
+		m_LastSpan = {};
+		for (Token& t : m_Lookahead) t = fetch();
+		m_CurrentToken = &m_Lookahead[0];
+	}
 
-		if (m_TokenIndex < m_Tokens.size())
-		{
-			m_CurrentToken = &m_Tokens[m_TokenIndex];
-		}
+	Token& Parser::peek(size_t offset)
+	{
+		ASSERT(offset < LOOKAHEAD, "peek beyond the lookahead buffer");
+		return m_Lookahead[(m_LookaheadStart + offset) % LOOKAHEAD];
 	}
 
-	void Parser::retreat()
+	void Parser::advance()
 	{
-		--m_TokenIndex;
-		if (m_TokenIndex >= 0)
-		{
-			m_CurrentToken = &m_Tokens[m_TokenIndex];
-		}
+		if (m_CurrentToken->type == TokenType::NONE) return;
+
+		m_Lookahead[m_LookaheadStart] = fetch();
+		m_LookaheadStart = (m_LookaheadStart + 1) % LOOKAHEAD;
+		m_CurrentToken = &m_Lookahead[m_LookaheadStart];
 	}
 
 	ParseResult Parser::atom()
@@ -144,66 +185,23 @@ namespace Chronos
 		case TokenType::FLOAT:
 		{
 			advance();
-			return new Node({ NodeType::NUM, t, t.start_pos, t.end_pos });
+			return make_node({ NodeType::NUM, t, t.span() });
 		}
 		case TokenType::ID:
 		{
 			advance();
-			return new Node({ NodeType::ACCESS, std::get<std::string>(t.value), t.start_pos, t.end_pos });
-		}
-		case TokenType::LROUND:
-		{
-			advance();
-			ParseResult res = expression();
-			if (res.index() == (int) ParseRes::ERROR) return res;
-			Node* expr = std::get<Node*>(res);
-
-			if (m_CurrentToken->type == TokenType::RROUND)
-			{
-				advance();
-				return { expr };
-			}
-			else {
-				std::string details = "Parser: expected ')' found: " + to_string(t.type);
-			Error e = { ErrorType::INVALID_SYNTAX, details, m_CurrentToken->start_pos, m_CurrentToken->end_pos };
-			return e;
-			}
+			return make_node({ NodeType::ACCESS, t.as_symbol(), t.span() });
 		}
 
 		default:
 		{
 			std::string details = "Parser: expected INT, FLOAT, IDENTIFIER, '+', '-', or '(', found: " + to_string(t.type);
-			Error e = { ErrorType::INVALID_SYNTAX, details, t.start_pos, t.end_pos };
+			Error e = { ErrorType::INVALID_SYNTAX, details, t.span() };
 			return e;
 		}
 		}
 	}
 
-	ParseResult Parser::factor()
-	{
-		Token t = *m_CurrentToken;
-
-		switch (t.type)
-		{
-		case TokenType::NOT:
-		case TokenType::SUB:
-		{
-			advance();
-			if (m_TokenIndex >= m_Tokens.size()) return Error({ ErrorType::INVALID_SYNTAX, "Parser: Expected Expression found EOF", t.start_pos, t.end_pos });
-			auto fac = factor();
-			if (fac.index() == (int) ParseRes::ERROR) return fac;
-			Node* fac_node = std::get<Node*>(fac);
-			Node* n = new Node({ NodeType::UNRYOP, 0, t.start_pos, fac_node->end_pos });
-			n->value = UnryOp { t.type, fac_node };
-			return n;
-		}
-
-		default:
-			return callable();
-		}
-
-	}
-
 	ParseResult Parser::wrap_callable(Node* node)
 	{
 		if (m_CurrentToken->type == TokenType::LROUND)
@@ -217,89 +215,248 @@ namespace Chronos
 		}
 	}
 
-	ParseResult Parser::callable()
+	// whether 'pending' has to be reduced before the binary operator 'op' is pushed
+	bool Parser::binds_before(const PendingOp& pending, TokenType op)
 	{
-		auto res = atom();
-		if (res.index() == (int) ParseRes::ERROR) return res;
-		Node* res_node = std::get<Node*>(res);
-		return wrap_callable(res_node);
+		if (pending.kind != PendingOp::BINOP) return false;
+
+		const BinopInfo& left = BINOP_TABLE[(size_t) pending.token.type];
+		const BinopInfo& right = BINOP_TABLE[(size_t) op];
+		return left.precedence > right.precedence || (left.precedence == right.precedence && right.assoc == Assoc::LEFT);
 	}
 
-	ParseResult Parser::term()
+	void Parser::reduce()
 	{
-		return binop_expression(&Parser::factor, { TokenType::MUL, TokenType::DIV }, &Parser::factor);
+		PendingOp op = m_Operators.back();
+		m_Operators.pop_back();
+
+		Node* right = m_Operands.back();
+		m_Operands.pop_back();
+
+		switch (op.kind)
+		{
+		case PendingOp::BINOP:
+		{
+			Node* left = m_Operands.back();
+			m_Operands.pop_back();
+
+			Node* node = make_node({ NodeType::BINOP, 0, span_between(left->span, right->span) });
+			node->value = BinOp { left, op.token.type, right };
+			m_Operands.push_back(node);
+			break;
+		}
+		case PendingOp::UNRYOP:
+		{
+			Node* node = make_node({ NodeType::UNRYOP, 0, span_between(op.token.span(), right->span) });
+			node->value = UnryOp { op.token.type, right };
+			m_Operands.push_back(node);
+			break;
+		}
+		case PendingOp::ASSIGN:
+			m_Operands.push_back(make_node({ NodeType::ASSIGN, AssignOp { op.token.as_symbol(), right }, span_between(op.token.span(), right->span) }));
+			break;
+
+		default:
+			ASSERT(false, "an open '(' can not be reduced");
+			exit(-1);
+		}
 	}
 
-	ParseResult Parser::arith_expression()
+	// operator precedence parsing with explicit operand and operator stacks instead
+	// of one call per nesting level, so deeply nested input can't overflow the stack.
+	// Unary operators bind to the operand right after them, an assignment is only
+	// recognized at the start of an expression, same as the recursive grammar
+	ParseResult Parser::expression()
 	{
-		return binop_expression(&Parser::term, { TokenType::ADD, TokenType::SUB }, &Parser::term);
+		m_Operands.clear();
+		m_Operators.clear();
+
+		bool expression_start = true;
+
+		while (true)
+		{
+			Token t = *m_CurrentToken;
+
+			if (expression_start && t.type == TokenType::ID && peek(1).type == TokenType::ASSIGN)
+			{
+				m_Operators.push_back({ PendingOp::ASSIGN, t });
+				advance();
+				advance();
+				continue;
+			}
+
+			expression_start = false;
+
+			if (t.type == TokenType::NOT || t.type == TokenType::SUB)
+			{
+				advance();
+				if (m_CurrentToken->type == TokenType::NONE) return Error({ ErrorType::INVALID_SYNTAX, "Parser: Expected Expression found EOF", t.span() });
+				m_Operators.push_back({ PendingOp::UNRYOP, t });
+				continue;
+			}
+
+			if (t.type == TokenType::LROUND)
+			{
+				advance();
+				m_Operators.push_back({ PendingOp::PAREN, t });
+				expression_start = true;
+				continue;
+			}
+
+			ParseResult res = atom();
+			if (res.index() == (int) ParseRes::ERROR) return res;
+			res = wrap_callable(std::get<Node*>(res));
+			if (res.index() == (int) ParseRes::ERROR) return res;
+			m_Operands.push_back(std::get<Node*>(res));
+
+			// after an operand: close parentheses until the next binary operator,
+			// which needs another operand, or the end of the expression
+			while (true)
+			{
+				while (!m_Operators.empty() && m_Operators.back().kind == PendingOp::UNRYOP) reduce();
+
+				TokenType type = m_CurrentToken->type;
+				if (BINOP_TABLE[(size_t) type].precedence != 0)
+				{
+					while (!m_Operators.empty() && binds_before(m_Operators.back(), type)) reduce();
+					m_Operators.push_back({ PendingOp::BINOP, *m_CurrentToken });
+					advance();
+					break;
+				}
+
+				while (!m_Operators.empty() && m_Operators.back().kind != PendingOp::PAREN) reduce();
+
+				if (m_Operators.empty())
+				{
+					ASSERT(m_Operands.size() == 1, "expression did not reduce to one node");
+					return m_Operands.back();
+				}
+
+				if (type != TokenType::RROUND)
+				{
+					std::string details = "Parser: expected ')' found: " + to_string(m_Operators.back().token.type);
+					Error e = { ErrorType::INVALID_SYNTAX, details, m_CurrentToken->span() };
+					return e;
+				}
+
+				m_Operators.pop_back();
+				advance();
+
+				res = wrap_callable(m_Operands.back());
+				if (res.index() == (int) ParseRes::ERROR) return res;
+			}
+		}
 	}
 
-	ParseResult Parser::comp_expression()
+	ParseResult Parser::parse_nodes()
 	{
-		return binop_expression(&Parser::arith_expression, 
-			{ TokenType::EQUAL, TokenType::LESS, TokenType::GREATER, TokenType::LESS_EQ, TokenType::GREATER_EQ },
-			&Parser::arith_expression);
+		if (m_CurrentToken->type == TokenType::NONE) return nullptr;
+		return expression();
 	}
 
-	ParseResult Parser::binop_expression(std::function<ParseResult(Parser*)> func_a, std::vector<TokenType> ops,
-		std::function<ParseResult(Parser*)> func_b)
+	ParseResult Parser::parse_program()
 	{
-		auto left = func_a(this);
-		if (left.index() == (int) ParseRes::ERROR) return left;
-		Node* left_node = std::get<Node*>(left);
-		
-		while (std::find(ops.begin(), ops.end(), m_CurrentToken->type) != ops.end())
+		Node* root = make_root(*m_Arena);
+
+		while (m_CurrentToken->type != TokenType::NONE)
 		{
-			Token op_token = *m_CurrentToken;
-			advance();
+			if (m_CurrentToken->type == TokenType::SEMICLN)
+			{
+				advance();
+				continue;
+			}
 
-			auto right = func_b(this);
-			if (right.index() == (int) ParseRes::ERROR) return right;
-			Node* right_node = std::get<Node*>(right);
+			ParseResult res = expression();
+			if (res.index() == (int) ParseRes::ERROR) return res;
+			std::get<Root>(root->value).nodes.push_back(std::get<Node*>(res));
 
-			Node* node = new Node({ NodeType::BINOP, 0, left_node->start_pos, right_node->end_pos});
-			node->value = BinOp { left_node, op_token.type, right_node };
-			left_node = node;
+			if (m_CurrentToken->type != TokenType::SEMICLN && m_CurrentToken->type != TokenType::NONE)
+			{
+				std::string details = "Parser: expected ';' found: " + to_string(m_CurrentToken->type);
+				Error e = { ErrorType::INVALID_SYNTAX, details, m_CurrentToken->span() };
+				return e;
+			}
 		}
 
-		return { left_node };
+		return root;
 	}
 
-	ParseResult Parser::expression()
+	struct ParsedChunk
+	{
+		std::deque<Token> tokens;
+		Arena arena;
+		ParseResult result = nullptr;
+	};
+
+	// splits a preloaded token stream right after top-level ';' and parses the
+	// pieces on 'pool', statements never depend on each other while parsing so the
+	// root, and the first error, are the same as parse_program()
+	ParseResult Parser::parse_program(ThreadPool& pool)
 	{
-		switch (m_CurrentToken->type)
+		if (m_Lexer) return parse_program();
+
+		std::deque<Token> tokens;
+		for (size_t i = 0; i < LOOKAHEAD; i++)
 		{
-		case TokenType::ID:
+			if (peek(i).type != TokenType::NONE) tokens.push_back(peek(i));
+		}
+		tokens.insert(tokens.end(), m_Tokens.begin(), m_Tokens.end());
+
+		size_t chunk_count = std::min(pool.size(), tokens.size() / PARALLEL_MIN_TOKENS);
+		if (chunk_count <= 1)
 		{
-			Token var = *m_CurrentToken;
-			advance();
+			load_tokens(std::move(tokens));
+			return parse_program();
+		}
 
-			if (m_CurrentToken->type == TokenType::ASSIGN)
-			{
-				advance();
-				ParseResult res = expression();
-				if (res.index() == (int) ParseRes::ERROR) return res;
-				return new Node({ NodeType::ASSIGN, AssignOp { std::get<std::string>(var.value), std::get<Node*>(res) } });
-			}
-			else
+		std::vector<ParsedChunk> chunks(chunk_count);
+		size_t begin = 0;
+		for (size_t i = 0; i < chunk_count; i++)
+		{
+			size_t end = tokens.size();
+			if (i + 1 < chunk_count)
 			{
-				retreat();
-				return binop_expression(&Parser::comp_expression, { TokenType::KW_AND, TokenType::KW_OR }, &Parser::comp_expression);
+				// a ';' inside parentheses is a syntax error, cutting there would change the message
+				size_t depth = 0;
+				for (end = begin; end < tokens.size(); end++)
+				{
+					TokenType type = tokens[end].type;
+					if (type == TokenType::LROUND) depth++;
+					else if (type == TokenType::RROUND && depth > 0) depth--;
+					else if (type == TokenType::SEMICLN && depth == 0 && end >= tokens.size() * (i + 1) / chunk_count) break;
+				}
+				end = std::min(end + 1, tokens.size());
 			}
+
+			chunks[i].tokens.assign(tokens.begin() + begin, tokens.begin() + end);
+			begin = end;
 		}
-		default:
+
+		for (ParsedChunk& chunk : chunks)
 		{
-			return binop_expression(&Parser::comp_expression, { TokenType::KW_AND, TokenType::KW_OR }, &Parser::comp_expression);
+			pool.submit([&chunk]()
+			{
+				Parser parser(chunk.arena);
+				parser.load_tokens(std::move(chunk.tokens));
+				chunk.result = parser.parse_program();
+			});
 		}
+		pool.wait();
+
+		m_Tokens.clear();
+		reset_lookahead();
+
+		Node* root = make_root(*m_Arena);
+		for (ParsedChunk& chunk : chunks)
+		{
+			m_Arena->adopt(chunk.arena);
+			if (chunk.result.index() == (int) ParseRes::ERROR) return chunk.result;
+
+			NodeList& nodes = std::get<Root>(std::get<Node*>(chunk.result)->value).nodes;
+			std::get<Root>(root->value).nodes.insert(std::get<Root>(root->value).nodes.end(), nodes.begin(), nodes.end());
 		}
-		//return binop_expression(&Parser::comp_expression, { TokenType::KW_AND, TokenType::KW_OR }, &Parser::comp_expression);
-	}
 
-	ParseResult Parser::parse_nodes()
-	{
-		if (m_Tokens.empty()) return nullptr;
-		return expression();
+		return root;
 	}
 
 }
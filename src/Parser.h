@@ -1,8 +1,9 @@
 #pragma once
 
+#include <array>
 #include <vector>
-#include <functional>
 
+#include "Arena.h"
 #include "Debug.h"
 #include "Lexer.h"
 #include "Error.h"
@@ -11,9 +12,9 @@ namespace Chronos
 {
 	struct Node;
 
-	void delete_nodes(Node* nodes);
+	using NodeList = std::vector<Node*, ArenaAllocator<Node*>>;
 
-	enum class ValueType
+	enum class ValueType : uint8_t
 	{
 		INT,
 		FLOAT,
@@ -23,7 +24,7 @@ namespace Chronos
 	};
 
 
-	enum class NodeType
+	enum class NodeType : uint8_t
 	{
 		NUM = 0,
 		BINOP,
@@ -38,7 +39,7 @@ namespace Chronos
 	{
 		struct Root
 		{
-			std::vector<Node*> nodes;
+			NodeList nodes;
 		};
 
 		struct UnryOp
@@ -49,7 +50,7 @@ namespace Chronos
 
 		struct AssignOp
 		{
-			std::string var;
+			SymbolID var;
 			Node* expr;
 		};
 
@@ -68,57 +69,150 @@ namespace Chronos
 	};
 
 	using ParseResult = std::variant<Error, Node*>;
-	using NodeValue = std::variant<int, std::string, Token, NodeValues::UnryOp, NodeValues::AssignOp, NodeValues::BinOp, Node*, NodeValues::Root>;
+	using NodeValue = std::variant<int, SymbolID, Token, NodeValues::UnryOp, NodeValues::AssignOp, NodeValues::BinOp, Node*, NodeValues::Root>;
 
 	struct Node
 	{
 		NodeType type;
 		NodeValue value;
 
-		Position start_pos;
-		Position end_pos;
+		Span span;
 
 		ValueType value_type = ValueType::NONE;
 	};
 
 	//using ParseResult = Result<Node*, Error>;
 
+	// calls 'f' on every node of the tree below 'root' after its operands, left
+	// to right. Uses an explicit stack, so it works on trees of any depth
+	template<typename F>
+	void for_each_post_order(Node* root, F&& f)
+	{
+		if (!root) return;
+
+		std::vector<std::pair<Node*, bool>> stack = { { root, false } };
+
+		while (!stack.empty())
+		{
+			auto [node, expanded] = stack.back();
+			stack.pop_back();
+
+			if (expanded)
+			{
+				f(node);
+				continue;
+			}
+
+			stack.push_back({ node, true });
+
+			// pushed in reverse so they are visited in order
+			switch (node->type)
+			{
+			case NodeType::BINOP:
+				stack.push_back({ std::get<NodeValues::BinOp>(node->value).right, false });
+				stack.push_back({ std::get<NodeValues::BinOp>(node->value).left, false });
+				break;
+			case NodeType::UNRYOP:
+				stack.push_back({ std::get<NodeValues::UnryOp>(node->value).right, false });
+				break;
+			case NodeType::ASSIGN:
+				stack.push_back({ std::get<NodeValues::AssignOp>(node->value).expr, false });
+				break;
+			case NodeType::ROOT:
+			{
+				NodeList& nodes = std::get<NodeValues::Root>(node->value).nodes;
+				for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+				{
+					if (*it) stack.push_back({ *it, false });
+				}
+				break;
+			}
+			// NUM and ACCESS are leaves
+			default:
+				break;
+			}
+		}
+	}
+
 
-	std::string to_string(const Node& n);
+	std::string to_string(const Node& n, const StringTable& strings);
+
+	// empty ROOT node whose statement list also lives in 'arena'
+	Node* make_root(Arena& arena);
 
 	class Parser
 	{
 	private:
+		// tokens are either pulled from m_Lexer on demand or taken from a preloaded
+		// stream, the parser itself only ever holds LOOKAHEAD of them
+		static const size_t LOOKAHEAD = 2;
+
+		Arena* m_Arena = nullptr;
+		Lexer* m_Lexer = nullptr;
 		std::deque<Token> m_Tokens = {};
-		size_t m_TokenIndex = 0;
+
+		std::array<Token, LOOKAHEAD> m_Lookahead = {};
+		size_t m_LookaheadStart = 0;
+		Span m_LastSpan = {};
 		Token* m_CurrentToken = nullptr;
 
+		Node* make_node(Node node);
+
+		Token fetch();
+		void reset_lookahead();
+		Token& peek(size_t offset);
 		void advance();
-		void retreat();
+
+		// operator whose operands are still being parsed, PAREN marks an open '('
+		struct PendingOp
+		{
+			enum Kind : uint8_t
+			{
+				BINOP,
+				UNRYOP,
+				ASSIGN,
+				PAREN,
+			};
+
+			Kind kind;
+			Token token;
+		};
+
+		// work stacks of expression(), kept to reuse their memory between statements
+		std::vector<Node*> m_Operands;
+		std::vector<PendingOp> m_Operators;
 
 		ParseResult atom();
-		ParseResult factor();
 		ParseResult wrap_callable(Node* node);
-		ParseResult callable();
-		ParseResult term();
-		ParseResult arith_expression();
-		ParseResult comp_expression();
-		ParseResult binop_expression(std::function<ParseResult(Parser*)> func_a, std::vector<TokenType> ops,
-			std::function<ParseResult(Parser*)> func_b);
+		bool binds_before(const PendingOp& pending, TokenType op);
+		void reduce();
 		ParseResult expression();
 
 	public:
-		void load_tokens(std::deque<Token> tokens)
+		// every node the parser creates is allocated in 'arena' and lives until it is reset
+		Parser(Arena& arena)
+			: m_Arena(&arena) {}
+
+		void load_tokens(std::deque<Token>&& tokens)
 		{
+			m_Lexer = nullptr;
 			m_Tokens = std::move(tokens);
-			m_TokenIndex = 0;
-			if (!m_Tokens.empty()) 
-			{
-				m_CurrentToken = &m_Tokens[0];
-			}
+			reset_lookahead();
 		}
 
+		void load_lexer(Lexer& lexer)
+		{
+			m_Lexer = &lexer;
+			m_Tokens.clear();
+			reset_lookahead();
+		}
+
+		// streams with fewer tokens than this per worker are parsed on one thread
+		static const size_t PARALLEL_MIN_TOKENS = 1 << 16;
+
 		ParseResult parse_nodes();
+		ParseResult parse_program();
+		ParseResult parse_program(ThreadPool& pool);
 
 	};
 
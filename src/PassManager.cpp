@@ -0,0 +1,106 @@
+#include "PassManager.h"
+
+#include <cstdio>
+
+namespace Chronos
+{
+	PassStats& PassManager::stats_of(const char* name)
+	{
+		for (PassStats& stats : m_Passes)
+		{
+			if (stats.name == name) return stats;
+		}
+
+		m_Passes.push_back({ name });
+		return m_Passes.back();
+	}
+
+	void PassManager::add_counter(const char* name, size_t value)
+	{
+		for (auto& counter : m_Counters)
+		{
+			if (counter.first == name)
+			{
+				counter.second += value;
+				return;
+			}
+		}
+
+		m_Counters.push_back({ name, value });
+	}
+
+	std::string PassManager::report() const
+	{
+		double total = 0.0;
+		for (const PassStats& stats : m_Passes) total += stats.seconds;
+
+		std::string s = "Pass execution timing report:\n";
+		char line[256];
+
+		snprintf(line, sizeof(line), " %-14s %12s %7s %12s %14s %14s\n", "pass", "wall (ms)", "%", "allocs", "peak bytes", "produced");
+		s += line;
+
+		for (const PassStats& stats : m_Passes)
+		{
+			double percent = total > 0.0 ? 100.0 * stats.seconds / total : 0.0;
+			std::string allocations = "n/a", peak = "n/a";
+			if (MemoryStats::COUNTS_HEAP)
+			{
+				allocations = std::to_string(stats.allocations);
+				peak = std::to_string(stats.peak_bytes);
+			}
+
+			snprintf(line, sizeof(line), " %-14s %12.3f %6.1f%% %12s %14s %14zu %s\n",
+				stats.name.c_str(), stats.seconds * 1000.0, percent, allocations.c_str(), peak.c_str(), stats.count, stats.unit);
+			s += line;
+		}
+
+		snprintf(line, sizeof(line), " %-14s %12.3f\n", "TOTAL", total * 1000.0);
+		s += line;
+
+		for (const auto& counter : m_Counters)
+		{
+			if (!counter.second) continue;
+			snprintf(line, sizeof(line), " %-34s %12zu\n", counter.first.c_str(), counter.second);
+			s += line;
+		}
+
+		return s;
+	}
+
+	std::string PassManager::report_json() const
+	{
+		std::string s = "{\n  \"passes\": [\n";
+		char line[512];
+
+		for (size_t i = 0; i < m_Passes.size(); i++)
+		{
+			const PassStats& stats = m_Passes[i];
+			std::string allocations = "null", peak = "null";
+			if (MemoryStats::COUNTS_HEAP)
+			{
+				allocations = std::to_string(stats.allocations);
+				peak = std::to_string(stats.peak_bytes);
+			}
+
+			snprintf(line, sizeof(line),
+				"    { \"name\": \"%s\", \"runs\": %zu, \"seconds\": %.9f, \"allocations\": %s, \"peak_bytes\": %s, \"count\": %zu, \"unit\": \"%s\" }%s\n",
+				stats.name.c_str(), stats.runs, stats.seconds, allocations.c_str(), peak.c_str(), stats.count, stats.unit, i + 1 < m_Passes.size() ? "," : "");
+			s += line;
+		}
+
+		s += "  ],\n  \"counters\": {";
+
+		bool first = true;
+		for (const auto& counter : m_Counters)
+		{
+			if (!counter.second) continue;
+			snprintf(line, sizeof(line), "%s\n    \"%s\": %zu", first ? "" : ",", counter.first.c_str(), counter.second);
+			s += line;
+			first = false;
+		}
+
+		s += first ? "}\n}\n" : "\n  }\n}\n";
+		return s;
+	}
+}
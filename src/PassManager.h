@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "MemoryStats.h"
+
+namespace Chronos
+{
+	struct PassStats
+	{
+		std::string name;
+		size_t runs = 0;
+		double seconds = 0.0;
+		size_t allocations = 0;
+		size_t peak_bytes = 0;		// highest heap use above what was in use when the pass started
+
+		size_t count = 0;			// what the pass produced, tokens, nodes or instructions
+		const char* unit = "";
+	};
+
+	// runs the stages of a compilation as named passes and measures each one,
+	// a pass that runs again (once per file) adds to its earlier numbers
+	class PassManager
+	{
+	private:
+		std::vector<PassStats> m_Passes;
+		// events a pass counted, like the rewrites of every peephole rule
+		std::vector<std::pair<std::string, size_t>> m_Counters;
+
+		PassStats& stats_of(const char* name);
+
+	public:
+		// runs 'pass' as 'name', which returns what it produced as a count of 'unit'
+		template<typename F>
+		void run(const char* name, const char* unit, F&& pass)
+		{
+			size_t allocations = MemoryStats::allocations.load();
+			size_t bytes = MemoryStats::bytes.load();
+			MemoryStats::reset_peak();
+			auto start = std::chrono::steady_clock::now();
+
+			size_t count = pass();
+
+			auto end = std::chrono::steady_clock::now();
+			size_t peak = MemoryStats::peak_bytes.load();
+
+			PassStats& stats = stats_of(name);
+			stats.runs++;
+			stats.seconds += std::chrono::duration<double>(end - start).count();
+			stats.allocations += MemoryStats::allocations.load() - allocations;
+			stats.peak_bytes = std::max(stats.peak_bytes, peak > bytes ? peak - bytes : 0);
+			stats.count += count;
+			stats.unit = unit;
+		}
+
+		// adds 'value' to the counter 'name', counters that stay 0 are not reported
+		void add_counter(const char* name, size_t value);
+
+		const std::vector<PassStats>& get_passes() const { return m_Passes; }
+
+		// table in the style of -ftime-report
+		std::string report() const;
+		std::string report_json() const;
+	};
+}
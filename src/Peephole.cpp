@@ -0,0 +1,703 @@
+#include "Peephole.h"
+
+#include <cstring>
+
+#include "Debug.h"
+
+namespace Chronos
+{
+	using namespace x86ASM;
+
+	using Operand = std::variant<MemAccess, int, float, bool>;
+
+	// what an operand of a pattern accepts, as a mask
+	enum ArgKind : uint8_t
+	{
+		NONE = 0,
+		REG = 1,		// a register other than ESP/EBP
+		MEM = 2,
+		IMM = 4,
+		LABEL = 8,
+		ANY = REG | MEM | IMM | LABEL,
+	};
+
+	static const uint8_t NO_SLOT = 0xff;
+	enum Slot : uint8_t { A, B, C, D, SLOT_COUNT };
+
+	// the first use of a slot binds the operand, later uses have to be the same
+	struct ArgPattern
+	{
+		uint8_t kinds = NONE;
+		uint8_t slot = NO_SLOT;
+	};
+
+	enum class Match : uint8_t
+	{
+		INST,
+		LABEL_DEF,		// a sub label, bound to its slot as an operand
+		ANY_INST,		// any instruction that is not a label
+	};
+
+	struct InstPattern
+	{
+		Match match = Match::INST;
+		std::vector<InstType> types;
+		ArgPattern args[2];
+	};
+
+	struct InstTemplate
+	{
+		Match match = Match::INST;
+		InstType type = NO_INST;
+		int8_t type_of = -1;		// takes the type of this pattern instruction instead
+		uint8_t args[2] = { NO_SLOT, NO_SLOT };
+	};
+
+	enum class Guard : uint8_t
+	{
+		REG_DEAD,			// the register in 'slot' is not read after the window
+		FLAGS_DEAD,			// the flags are not read after the window
+		FLAGS_DEAD_AT,		// the flags are not read at the label in 'slot'
+		IMM_ZERO,
+		IMM_NONZERO,
+		DISTINCT,			// the registers in 'slot' and 'other' do not overlap
+	};
+
+	struct Condition
+	{
+		Guard guard;
+		uint8_t slot = NO_SLOT;
+		uint8_t other = NO_SLOT;
+	};
+
+	struct Rule
+	{
+		const char* name;
+		std::vector<InstPattern> pattern;
+		std::vector<InstTemplate> replacement;
+		std::vector<Condition> conditions;
+	};
+
+	static ArgPattern arg(uint8_t kinds, uint8_t slot) { return { kinds, slot }; }
+
+	static InstPattern inst(std::vector<InstType> types, ArgPattern a = {}, ArgPattern b = {})
+	{
+		return { Match::INST, std::move(types), { a, b } };
+	}
+
+	static InstPattern label_def(uint8_t slot) { return { Match::LABEL_DEF, {}, { arg(LABEL, slot), {} } }; }
+	static InstPattern any_inst() { return { Match::ANY_INST, {}, {} }; }
+
+	static InstTemplate emit(InstType type, uint8_t a = NO_SLOT, uint8_t b = NO_SLOT)
+	{
+		return { Match::INST, type, -1, { a, b } };
+	}
+
+	static InstTemplate emit_type_of(int8_t pattern, uint8_t a = NO_SLOT, uint8_t b = NO_SLOT)
+	{
+		return { Match::INST, NO_INST, pattern, { a, b } };
+	}
+
+	static InstTemplate emit_label(uint8_t slot) { return { Match::LABEL_DEF, NO_INST, -1, { slot, NO_SLOT } }; }
+
+	static Condition reg_dead(uint8_t slot) { return { Guard::REG_DEAD, slot }; }
+	static Condition flags_dead() { return { Guard::FLAGS_DEAD }; }
+	static Condition flags_dead_at(uint8_t slot) { return { Guard::FLAGS_DEAD_AT, slot }; }
+	static Condition imm_zero(uint8_t slot) { return { Guard::IMM_ZERO, slot }; }
+	static Condition imm_nonzero(uint8_t slot) { return { Guard::IMM_NONZERO, slot }; }
+	static Condition distinct(uint8_t slot, uint8_t other) { return { Guard::DISTINCT, slot, other }; }
+
+	// tried in order at every instruction, a rewrite can enable others in the next round
+	static const std::vector<Rule> RULES =
+	{
+		{ "self-move",
+			{ inst({ MOV, MOVSS }, arg(REG, A), arg(REG, A)) },
+			{},
+			{} },
+
+		{ "push-pop",
+			{ inst({ PUSH }, arg(ANY, A)), inst({ POP }, arg(REG, B)) },
+			{ emit(MOV, B, A) },
+			{} },
+
+		// a value stored and loaded right back is still in the register it came from
+		{ "store-reload",
+			{ inst({ MOV }, arg(MEM, A), arg(REG | IMM, B)), inst({ MOV }, arg(REG, C), arg(MEM, A)) },
+			{ emit(MOV, A, B), emit(MOV, C, B) },
+			{} },
+
+		{ "store-reload-ss",
+			{ inst({ MOVSS }, arg(MEM, A), arg(REG, B)), inst({ MOVSS }, arg(REG, C), arg(MEM, A)) },
+			{ emit(MOVSS, A, B), emit(MOVSS, C, B) },
+			{} },
+
+		{ "load-push",
+			{ inst({ MOV }, arg(REG, A), arg(MEM | IMM, B)), inst({ PUSH }, arg(REG, A)) },
+			{ emit(PUSH, B) },
+			{ reg_dead(A) } },
+
+		// a load only feeding one instruction becomes its memory operand
+		{ "load-op",
+			{ inst({ MOV }, arg(REG, A), arg(MEM, B)), inst({ ADD, SUB, IMUL, AND, OR, XOR, CMP, CVTSI2SS, MOVD }, arg(REG, C), arg(REG, A)) },
+			{ emit_type_of(1, C, B) },
+			{ distinct(A, C), reg_dead(A) } },
+
+		{ "load-op-ss",
+			{ inst({ MOVSS }, arg(REG, A), arg(MEM, B)), inst({ ADDSS, SUBSS, MULSS, DIVSS, UCOMISS }, arg(REG, C), arg(REG, A)) },
+			{ emit_type_of(1, C, B) },
+			{ distinct(A, C), reg_dead(A) } },
+
+		{ "dead-move",
+			{ inst({ MOV, MOVSS, MOVD, MOVZX }, arg(REG, A), arg(ANY, B)) },
+			{},
+			{ reg_dead(A) } },
+
+		{ "add-zero",
+			{ inst({ ADD, SUB }, arg(REG, A), arg(IMM, B)) },
+			{},
+			{ imm_zero(B), flags_dead() } },
+
+		// an AND/OR whose left operand is a constant
+		{ "constant-je-taken",
+			{ inst({ MOV }, arg(REG, A), arg(IMM, B)), inst({ TEST }, arg(REG, A), arg(REG, A)), inst({ JE, JZ }, arg(LABEL, C)) },
+			{ emit(MOV, A, B), emit(JMP, C) },
+			{ imm_zero(B), flags_dead_at(C) } },
+
+		{ "constant-je-dropped",
+			{ inst({ MOV }, arg(REG, A), arg(IMM, B)), inst({ TEST }, arg(REG, A), arg(REG, A)), inst({ JE, JZ }, arg(LABEL, C)) },
+			{ emit(MOV, A, B) },
+			{ imm_nonzero(B), flags_dead() } },
+
+		{ "constant-jne-taken",
+			{ inst({ MOV }, arg(REG, A), arg(IMM, B)), inst({ TEST }, arg(REG, A), arg(REG, A)), inst({ JNE }, arg(LABEL, C)) },
+			{ emit(MOV, A, B), emit(JMP, C) },
+			{ imm_nonzero(B), flags_dead_at(C) } },
+
+		{ "constant-jne-dropped",
+			{ inst({ MOV }, arg(REG, A), arg(IMM, B)), inst({ TEST }, arg(REG, A), arg(REG, A)), inst({ JNE }, arg(LABEL, C)) },
+			{ emit(MOV, A, B) },
+			{ imm_zero(B), flags_dead() } },
+
+		{ "jump-to-next",
+			{ inst({ JMP }, arg(LABEL, A)), label_def(A) },
+			{ emit_label(A) },
+			{} },
+
+		{ "branch-to-next",
+			{ inst({ JE, JNE, JP, JZ, JL, JLE, JG, JGE, JA, JNB, JB, JBE }, arg(LABEL, A)), label_def(A) },
+			{ emit_label(A) },
+			{} },
+
+		{ "unreachable",
+			{ inst({ JMP }, arg(LABEL, A)), any_inst() },
+			{ emit(JMP, A) },
+			{} },
+	};
+
+	// rules by the type of their first instruction, sub labels come after NO_INST
+	static std::vector<std::vector<uint32_t>> index_rules()
+	{
+		std::vector<std::vector<uint32_t>> rules((size_t) NO_INST + 2);
+
+		for (uint32_t r = 0; r < RULES.size(); r++)
+		{
+			const InstPattern& first = RULES[r].pattern[0];
+
+			switch (first.match)
+			{
+			case Match::INST:
+				for (InstType type : first.types) rules[type].push_back(r);
+				break;
+			case Match::LABEL_DEF:
+				rules[NO_INST + 1].push_back(r);
+				break;
+			case Match::ANY_INST:
+				for (uint32_t type = 0; type < NO_INST; type++) rules[type].push_back(r);
+				break;
+			}
+		}
+
+		return rules;
+	}
+
+	static const std::vector<std::vector<uint32_t>> RULES_BY_FIRST = index_rules();
+
+	static const uint32_t NO_POSITION = UINT32_MAX;
+	static const int MAX_ROUNDS = 8;
+	// instructions a liveness scan looks at before it gives up and says live
+	static const size_t SCAN_LIMIT = 256;
+
+	static Reg family(Reg reg)
+	{
+		switch (reg)
+		{
+		case Reg::AX: case Reg::AH: case Reg::AL: return Reg::EAX;
+		case Reg::CX: case Reg::CH: case Reg::CL: return Reg::ECX;
+		case Reg::DX: case Reg::DH: case Reg::DL: return Reg::EDX;
+		case Reg::BX: case Reg::BH: case Reg::BL: return Reg::EBX;
+		case Reg::SP: return Reg::ESP;
+		case Reg::BP: return Reg::EBP;
+		case Reg::SI: return Reg::ESI;
+		case Reg::DI: return Reg::EDI;
+		default: return reg;
+		}
+	}
+
+	static bool is_xmm(Reg reg)
+	{
+		return reg >= Reg::XMM0 && reg <= Reg::XMM7;
+	}
+
+	static bool is_reg(const Operand& op)
+	{
+		if (op.index() != MEM_ACCESS) return false;
+		const MemAccess& acc = std::get<MemAccess>(op);
+		return acc.size == NO_DEREF && acc.adress.index() == REGISTER;
+	}
+
+	static Reg reg_of(const Operand& op)
+	{
+		return std::get<Reg>(std::get<MemAccess>(op).adress);
+	}
+
+	static bool is_kind(const Operand& op, uint8_t kinds)
+	{
+		switch (op.index())
+		{
+		case INT_VALUE:
+		case FLOAT_VALUE:
+			return kinds & IMM;
+		case MEM_ACCESS:
+		{
+			const MemAccess& acc = std::get<MemAccess>(op);
+			if (acc.size != NO_DEREF) return kinds & MEM;
+			if (acc.adress.index() != REGISTER) return kinds & LABEL;
+
+			Reg reg = family(std::get<Reg>(acc.adress));
+			return (kinds & REG) && reg != Reg::ESP && reg != Reg::EBP;
+		}
+		default:
+			return false;
+		}
+	}
+
+	static bool same_address(const MemAdress& l, const MemAdress& r)
+	{
+		if (l.index() != r.index()) return false;
+
+		switch (l.index())
+		{
+		case REGISTER: return std::get<Reg>(l) == std::get<Reg>(r);
+		case LABEL_ADR: return std::strcmp(std::get<const char*>(l), std::get<const char*>(r)) == 0;
+		case SUB_LABEL_ADR: return std::get<SubLabel>(l).count == std::get<SubLabel>(r).count;
+		default: return false;
+		}
+	}
+
+	static bool same_operand(const Operand& l, const Operand& r)
+	{
+		if (l.index() != r.index()) return false;
+
+		switch (l.index())
+		{
+		case MEM_ACCESS:
+		{
+			const MemAccess& a = std::get<MemAccess>(l);
+			const MemAccess& b = std::get<MemAccess>(r);
+			return same_address(a.adress, b.adress) && a.offset == b.offset && a.size == b.size && a.index == b.index && a.scale == b.scale;
+		}
+		case INT_VALUE: return std::get<int>(l) == std::get<int>(r);
+		case FLOAT_VALUE: return std::memcmp(&std::get<float>(l), &std::get<float>(r), sizeof(float)) == 0;
+		default: return true;
+		}
+	}
+
+	static bool is_conditional_jump(InstType type)
+	{
+		switch (type)
+		{
+		case JE: case JNE: case JP: case JZ: case JL: case JLE: case JG: case JGE: case JA: case JNB: case JB: case JBE:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	enum class FlagUse : uint8_t { NONE, READ, WRITE };
+
+	// instructions not listed are taken to read the flags
+	static FlagUse flag_use(InstType type)
+	{
+		switch (type)
+		{
+		case JE: case JNE: case JP: case JZ: case JL: case JLE: case JG: case JGE: case JA: case JNB: case JB: case JBE:
+		case SETE: case SETNE: case SETA: case SETNB: case SETB: case SETBE: case SETNP: case SETP:
+		case SETL: case SETLE: case SETG: case SETGE:
+			return FlagUse::READ;
+
+		case ADD: case SUB: case MUL: case IMUL: case DIV: case IDIV: case NEG: case AND: case OR: case XOR:
+		case SHL: case SHR: case SAR: case CMP: case TEST: case UCOMISS: case FCOMIP: case CALL: case INT:
+			return FlagUse::WRITE;
+
+		case PUSH: case MOV: case MOVZX: case LEA: case POP: case NOP: case CDQ: case JMP:
+		case FLD: case FLID: case FSTP: case FISTP: case FISTTP: case FADD: case FSUB: case FMUL: case FDIV:
+		case MOVD: case MOVSS: case ADDSS: case SUBSS: case MULSS: case DIVSS: case PXOR:
+		case CVTSI2SD: case CVTSI2SS: case CVTSS2SD:
+			return FlagUse::NONE;
+
+		default:
+			return FlagUse::READ;
+		}
+	}
+
+	struct RegUse
+	{
+		bool reads = false;
+		bool writes = false;	// the whole register, so its old value is dead
+	};
+
+	// how 'inst' uses the register family 'reg', naming it or implicitly
+	static RegUse reg_use(const BasicInst& inst, Reg reg)
+	{
+		RegUse use;
+		const Operand& dst = inst.adresses[0];
+		const Operand& src = inst.adresses[1];
+
+		for (const Operand& op : inst.adresses)
+		{
+			if (op.index() != MEM_ACCESS) continue;
+			const MemAccess& acc = std::get<MemAccess>(op);
+			if (acc.size == NO_DEREF) continue;
+			if (acc.adress.index() == REGISTER && family(std::get<Reg>(acc.adress)) == reg) use.reads = true;
+			if (acc.index != Reg::NO_REG && family(acc.index) == reg) use.reads = true;
+		}
+
+		if (is_reg(src) && family(reg_of(src)) == reg) use.reads = true;
+
+		if (inst.type == CDQ)
+		{
+			if (reg == Reg::EAX) use.reads = true;
+			if (reg == Reg::EDX) use.writes = true;
+			return use;
+		}
+
+		// MUL, DIV, IDIV and one operand IMUL work on EDX:EAX
+		bool divide = inst.type == DIV || inst.type == IDIV;
+		bool wide = divide || inst.type == MUL || (inst.type == IMUL && src.index() == NO_ADR);
+		if (wide)
+		{
+			if (reg == Reg::EAX || (reg == Reg::EDX && divide)) use.reads = true;
+			if (reg == Reg::EAX || reg == Reg::EDX) use.writes = true;
+			if (is_reg(dst) && family(reg_of(dst)) == reg) use.reads = true;
+			return use;
+		}
+
+		if (!is_reg(dst) || family(reg_of(dst)) != reg) return use;
+
+		switch (inst.type)
+		{
+		case MOV: case MOVZX: case LEA: case MOVD: case MOVSS: case CVTSI2SS: case POP:
+			// writing part of a register keeps the rest
+			if (reg_of(dst) != reg) use.reads = true;
+			use.writes = true;
+			break;
+		case CMP: case TEST: case UCOMISS: case PUSH:
+			use.reads = true;
+			break;
+		default:
+			use.reads = true;
+			use.writes = true;
+			break;
+		}
+
+		return use;
+	}
+
+	Peephole::Peephole()
+		: m_Hits(RULES.size(), 0) {}
+
+	void Peephole::index_labels(const std::vector<Instruction>& code)
+	{
+		m_Labels.clear();
+
+		for (uint32_t i = 0; i < code.size(); i++)
+		{
+			if (code[i].index() != SUB_LABEL) continue;
+
+			uint32_t label = std::get<SubLabel>(code[i]).count;
+			if (label >= m_Labels.size()) m_Labels.resize(label + 1, NO_POSITION);
+			m_Labels[label] = i;
+		}
+
+		if (m_Visited.size() < code.size()) m_Visited.resize(code.size(), 0);
+	}
+
+	static uint32_t jump_target(const BasicInst& inst, const std::vector<uint32_t>& labels)
+	{
+		const Operand& op = inst.adresses[0];
+		if (op.index() != MEM_ACCESS) return NO_POSITION;
+
+		const MemAdress& adress = std::get<MemAccess>(op).adress;
+		if (adress.index() != SUB_LABEL_ADR) return NO_POSITION;
+
+		uint32_t label = std::get<SubLabel>(adress).count;
+		return label < labels.size() ? labels[label] : NO_POSITION;
+	}
+
+	// follows both sides of every jump, a path that ends or runs too long counts as a read
+	bool Peephole::reg_dead(const std::vector<Instruction>& code, size_t from, Reg reg)
+	{
+		reg = family(reg);
+		if (reg == Reg::ESP || reg == Reg::EBP) return false;
+
+		bool caller_saved = reg == Reg::EAX || reg == Reg::ECX || reg == Reg::EDX || is_xmm(reg);
+		size_t budget = SCAN_LIMIT;
+		std::vector<size_t> paths = { from };
+		m_Epoch++;
+
+		while (!paths.empty())
+		{
+			size_t i = paths.back();
+			paths.pop_back();
+
+			for (;; i++)
+			{
+				if (i >= code.size() || budget-- == 0) return false;
+				if (m_Visited[i] == m_Epoch) break;
+				m_Visited[i] = m_Epoch;
+
+				if (code[i].index() == SUB_LABEL) continue;
+				if (code[i].index() != BASIC_INST) return false;
+
+				const BasicInst& inst = std::get<BasicInst>(code[i]);
+
+				// a call clobbers the caller saved registers, the exit syscall reads its arguments
+				if (inst.type == CALL)
+				{
+					if (caller_saved) break;
+					continue;
+				}
+				if (inst.type == INT)
+				{
+					if (is_xmm(reg)) break;
+					return false;
+				}
+
+				RegUse use = reg_use(inst, reg);
+				if (use.reads) return false;
+				if (use.writes) break;
+
+				if (inst.type == JMP || is_conditional_jump(inst.type))
+				{
+					uint32_t target = jump_target(inst, m_Labels);
+					if (target == NO_POSITION) return false;
+					paths.push_back(target);
+					if (inst.type == JMP) break;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool Peephole::flags_dead(const std::vector<Instruction>& code, size_t from)
+	{
+		size_t budget = SCAN_LIMIT;
+		std::vector<size_t> paths = { from };
+		m_Epoch++;
+
+		while (!paths.empty())
+		{
+			size_t i = paths.back();
+			paths.pop_back();
+
+			for (;; i++)
+			{
+				if (i >= code.size() || budget-- == 0) return false;
+				if (m_Visited[i] == m_Epoch) break;
+				m_Visited[i] = m_Epoch;
+
+				if (code[i].index() == SUB_LABEL) continue;
+				if (code[i].index() != BASIC_INST) return false;
+
+				const BasicInst& inst = std::get<BasicInst>(code[i]);
+				FlagUse use = flag_use(inst.type);
+				if (use == FlagUse::READ) return false;
+				if (use == FlagUse::WRITE) break;
+
+				if (inst.type == JMP)
+				{
+					uint32_t target = jump_target(inst, m_Labels);
+					if (target == NO_POSITION) return false;
+					paths.push_back(target);
+					break;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// tries every rule at 'at', appends the replacement of the first that applies
+	// to 'out' and returns the length of its window, 0 if none does
+	size_t Peephole::apply(const std::vector<Instruction>& code, size_t at, std::vector<Instruction>& out)
+	{
+		const Instruction& first = code[at];
+		size_t candidates = NO_INST + 1;
+		if (first.index() == BASIC_INST) candidates = std::get<BasicInst>(first).type;
+		else if (first.index() != SUB_LABEL) return 0;
+
+		for (uint32_t r : RULES_BY_FIRST[candidates])
+		{
+			const Rule& rule = RULES[r];
+			if (at + rule.pattern.size() > code.size()) continue;
+
+			Operand slots[SLOT_COUNT] = { false, false, false, false };
+			bool bound[SLOT_COUNT] = {};
+
+			auto bind = [&](const ArgPattern& pattern, const Operand& op)
+			{
+				if (pattern.kinds == NONE) return op.index() == NO_ADR;
+				if (!is_kind(op, pattern.kinds)) return false;
+				if (pattern.slot == NO_SLOT) return true;
+
+				if (bound[pattern.slot]) return same_operand(slots[pattern.slot], op);
+				slots[pattern.slot] = op;
+				bound[pattern.slot] = true;
+				return true;
+			};
+
+			bool matched = true;
+			for (size_t k = 0; k < rule.pattern.size() && matched; k++)
+			{
+				const InstPattern& pattern = rule.pattern[k];
+				const Instruction& instruction = code[at + k];
+
+				switch (pattern.match)
+				{
+				case Match::LABEL_DEF:
+					matched = instruction.index() == SUB_LABEL && bind(pattern.args[0], MemAccess(std::get<SubLabel>(instruction)));
+					break;
+				case Match::ANY_INST:
+				{
+					InstType type = instruction.index() == BASIC_INST ? std::get<BasicInst>(instruction).type : NO_INST;
+					matched = type != NO_INST && type != GLOBAL && type != EXTERN;
+					break;
+				}
+				case Match::INST:
+				{
+					if (instruction.index() != BASIC_INST) { matched = false; break; }
+					const BasicInst& inst = std::get<BasicInst>(instruction);
+
+					matched = false;
+					for (InstType type : pattern.types) matched |= type == inst.type;
+					matched = matched && bind(pattern.args[0], inst.adresses[0]) && bind(pattern.args[1], inst.adresses[1]);
+					break;
+				}
+				}
+			}
+
+			if (!matched) continue;
+
+			size_t after = at + rule.pattern.size();
+
+			for (const Condition& condition : rule.conditions)
+			{
+				const Operand& op = condition.slot == NO_SLOT ? slots[0] : slots[condition.slot];
+
+				switch (condition.guard)
+				{
+				case Guard::REG_DEAD:
+					matched = reg_dead(code, after, reg_of(op));
+					break;
+				case Guard::FLAGS_DEAD:
+					matched = flags_dead(code, after);
+					break;
+				case Guard::FLAGS_DEAD_AT:
+				{
+					uint32_t label = std::get<SubLabel>(std::get<MemAccess>(op).adress).count;
+					matched = label < m_Labels.size() && m_Labels[label] != NO_POSITION && flags_dead(code, m_Labels[label]);
+					break;
+				}
+				case Guard::IMM_ZERO:
+				case Guard::IMM_NONZERO:
+				{
+					bool zero = op.index() == INT_VALUE ? std::get<int>(op) == 0 : false;
+					if (op.index() == FLOAT_VALUE) matched = false;
+					else matched = zero == (condition.guard == Guard::IMM_ZERO);
+					break;
+				}
+				case Guard::DISTINCT:
+					matched = family(reg_of(op)) != family(reg_of(slots[condition.other]));
+					break;
+				}
+
+				if (!matched) break;
+			}
+
+			if (!matched) continue;
+
+			for (const InstTemplate& t : rule.replacement)
+			{
+				if (t.match == Match::LABEL_DEF)
+				{
+					out.push_back(std::get<SubLabel>(std::get<MemAccess>(slots[t.args[0]]).adress));
+					continue;
+				}
+
+				InstType type = t.type_of < 0 ? t.type : std::get<BasicInst>(code[at + t.type_of]).type;
+				BasicInst inst{ type, { false, false } };
+				for (int k = 0; k < 2; k++)
+				{
+					if (t.args[k] != NO_SLOT) inst.adresses[k] = slots[t.args[k]];
+				}
+				out.push_back(inst);
+			}
+
+			m_Hits[r]++;
+			return rule.pattern.size();
+		}
+
+		return 0;
+	}
+
+	// every round reads 'code' and writes the rewritten code to a new vector, so the
+	// liveness scans always see positions that match the label index
+	size_t Peephole::run(std::vector<Instruction>& code)
+	{
+		size_t total = 0;
+		std::vector<Instruction> out;
+
+		for (int round = 0; round < MAX_ROUNDS; round++)
+		{
+			index_labels(code);
+			out.clear();
+			out.reserve(code.size());
+
+			size_t rewrites = 0;
+			for (size_t i = 0; i < code.size();)
+			{
+				size_t window = apply(code, i, out);
+				if (window)
+				{
+					i += window;
+					rewrites++;
+				}
+				else out.push_back(code[i++]);
+			}
+
+			code.swap(out);
+			total += rewrites;
+			if (!rewrites) break;
+		}
+
+		return total;
+	}
+
+	std::vector<std::pair<const char*, size_t>> Peephole::get_hits() const
+	{
+		std::vector<std::pair<const char*, size_t>> hits;
+		for (size_t r = 0; r < RULES.size(); r++) hits.push_back({ RULES[r].name, m_Hits[r] });
+		return hits;
+	}
+}
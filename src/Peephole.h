@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Assembly.h"
+
+namespace Chronos
+{
+	// rewrites short windows of emitted instructions into cheaper ones. Every rule
+	// in the table is a pattern that binds operands to slots, a replacement built
+	// from those slots and the conditions under which the rewrite is safe
+	class Peephole
+	{
+	private:
+		std::vector<size_t> m_Hits;
+
+		// position of every sub label in the code being rewritten
+		std::vector<uint32_t> m_Labels;
+		// positions a liveness scan already went through, stamped with m_Epoch
+		std::vector<uint32_t> m_Visited;
+		uint32_t m_Epoch = 0;
+
+		void index_labels(const std::vector<x86ASM::Instruction>& code);
+		bool reg_dead(const std::vector<x86ASM::Instruction>& code, size_t from, x86ASM::Reg reg);
+		bool flags_dead(const std::vector<x86ASM::Instruction>& code, size_t from);
+		size_t apply(const std::vector<x86ASM::Instruction>& code, size_t at, std::vector<x86ASM::Instruction>& out);
+
+	public:
+		Peephole();
+
+		// rewrites 'code' until no rule applies, returns the number of rewrites
+		size_t run(std::vector<x86ASM::Instruction>& code);
+
+		// name and number of rewrites of every rule, in table order
+		std::vector<std::pair<const char*, size_t>> get_hits() const;
+	};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Debug.h"
+
+namespace Chronos
+{
+	using SymbolID = uint32_t;
+
+	// interns identifier names for one compilation, every stage after the lexer
+	// only passes the returned ids around
+	class StringTable
+	{
+	private:
+		// deque never moves its elements, so the views in m_Ids stay valid
+		std::deque<std::string> m_Strings;
+		std::unordered_map<std::string_view, SymbolID> m_Ids;
+
+	public:
+		SymbolID intern(std::string_view s)
+		{
+			auto it = m_Ids.find(s);
+			if (it != m_Ids.end()) return it->second;
+
+			SymbolID id = (SymbolID) m_Strings.size();
+			m_Strings.emplace_back(s);
+			m_Ids.emplace(m_Strings.back(), id);
+			return id;
+		}
+
+		std::string_view get(SymbolID id) const
+		{
+			ASSERT(id < m_Strings.size(), "symbol id out of range");
+			return m_Strings[id];
+		}
+
+		std::size_t size() const { return m_Strings.size(); }
+
+		void clear()
+		{
+			m_Ids.clear();
+			m_Strings.clear();
+		}
+	};
+}
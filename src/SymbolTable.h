@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Parser.h"
+#include "StringTable.h"
+
+namespace Chronos
+{
+	struct Symbol
+	{
+		SymbolID name;
+		int offset;		// frame slot at [EBP - offset], NO_SLOT if the value is never read
+		ValueType type;
+
+		static constexpr int NO_SLOT = 0;
+		static constexpr SymbolID NO_NAME = UINT32_MAX;
+	};
+
+	// every variable of one compilation, built by the type checker. ACCESS and
+	// ASSIGN nodes are resolved to an index in here, so later passes never look
+	// a name up again
+	class SymbolTable
+	{
+	private:
+		std::vector<Symbol> m_Symbols;
+		// indexed by SymbolID, the symbol a name refers to at this point of the program
+		std::vector<uint32_t> m_Current;
+		uint32_t m_FrameSize = 0;
+
+	public:
+		static constexpr uint32_t NO_SYMBOL = UINT32_MAX;
+
+		uint32_t lookup(SymbolID name) const
+		{
+			if (name >= m_Current.size()) return NO_SYMBOL;
+			return m_Current[name];
+		}
+
+		// a name keeps its symbol while it is assigned values of the same type,
+		// a value of another type gets a new symbol (and slot) from then on
+		uint32_t declare(SymbolID name, ValueType type, bool* created = nullptr)
+		{
+			uint32_t index = lookup(name);
+			bool is_new = index == NO_SYMBOL || m_Symbols[index].type != type;
+			if (created) *created = is_new;
+			if (!is_new) return index;
+
+			// until layout_frame runs every symbol gets a slot of its own
+			index = add({ name, (int) m_FrameSize + 4, type });
+			if (name >= m_Current.size()) m_Current.resize(name + 1, NO_SYMBOL);
+			m_Current[name] = index;
+			return index;
+		}
+
+		// a value without a name, for results the compiler keeps around itself
+		uint32_t make_temporary(ValueType type)
+		{
+			return add({ Symbol::NO_NAME, (int) m_FrameSize + 4, type });
+		}
+
+		uint32_t add(Symbol symbol)
+		{
+			m_Symbols.push_back(symbol);
+			m_FrameSize = std::max(m_FrameSize, (uint32_t) symbol.offset);
+			return (uint32_t) m_Symbols.size() - 1;
+		}
+
+		// used by layout_frame, which sets the frame size once every slot is placed
+		void set_offset(uint32_t index, int offset) { m_Symbols[index].offset = offset; }
+		void set_frame_size(uint32_t size) { m_FrameSize = size; }
+
+		const Symbol& operator[](uint32_t index) const
+		{
+			ASSERT(index < m_Symbols.size(), "symbol index out of range");
+			return m_Symbols[index];
+		}
+
+		const std::vector<Symbol>& get_symbols() const { return m_Symbols; }
+		uint32_t size() const { return (uint32_t) m_Symbols.size(); }
+
+		// bytes below EBP taken by all slots
+		uint32_t frame_size() const { return m_FrameSize; }
+
+		void clear()
+		{
+			m_Symbols.clear();
+			m_Current.clear();
+			m_FrameSize = 0;
+		}
+	};
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Chronos
+{
+	// fixed set of worker threads running submitted tasks, wait() blocks
+	// until every task submitted so far has finished
+	class ThreadPool
+	{
+	private:
+		std::vector<std::thread> m_Workers;
+		std::queue<std::function<void()>> m_Tasks;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_TaskReady;
+		std::condition_variable m_AllDone;
+		size_t m_Pending = 0;
+		bool m_Stop = false;
+
+		void work()
+		{
+			while (true)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(m_Mutex);
+					m_TaskReady.wait(lock, [this] { return m_Stop || !m_Tasks.empty(); });
+					if (m_Tasks.empty()) return;
+
+					task = std::move(m_Tasks.front());
+					m_Tasks.pop();
+				}
+
+				task();
+
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				if (--m_Pending == 0) m_AllDone.notify_all();
+			}
+		}
+
+	public:
+		ThreadPool(size_t count = std::thread::hardware_concurrency())
+		{
+			if (count == 0) count = 1;
+			for (size_t i = 0; i < count; i++) m_Workers.emplace_back(&ThreadPool::work, this);
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Stop = true;
+			}
+			m_TaskReady.notify_all();
+			for (std::thread& t : m_Workers) t.join();
+		}
+
+		size_t size() const { return m_Workers.size(); }
+
+		void submit(std::function<void()> task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Tasks.push(std::move(task));
+				++m_Pending;
+			}
+			m_TaskReady.notify_one();
+		}
+
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_AllDone.wait(lock, [this] { return m_Pending == 0; });
+		}
+	};
+}
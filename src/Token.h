@@ -1,3 +1,9 @@
+// TOKEN_TYPE(name) for every token, TOKEN_KEYWORD(name, spelling) for the ones
+// the lexer produces from an identifier with that exact spelling
+#ifndef TOKEN_KEYWORD
+#define TOKEN_KEYWORD(a, s) TOKEN_TYPE(a)
+#endif
+
 TOKEN_TYPE(INT)
 TOKEN_TYPE(FLOAT)
 TOKEN_TYPE(ADD)
@@ -12,8 +18,8 @@ TOKEN_TYPE(RCURLY)
 TOKEN_TYPE(ASSIGN)
 TOKEN_TYPE(SEMICLN)
 TOKEN_TYPE(ID)
-TOKEN_TYPE(IF)
-TOKEN_TYPE(ELSE)
+TOKEN_KEYWORD(IF, "if")
+TOKEN_KEYWORD(ELSE, "else")
 TOKEN_TYPE(KW_AND)
 TOKEN_TYPE(KW_OR)
 TOKEN_TYPE(EQUAL)
@@ -22,3 +28,6 @@ TOKEN_TYPE(GREATER)
 TOKEN_TYPE(LESS_EQ)
 TOKEN_TYPE(GREATER_EQ)
 TOKEN_TYPE(NONE)
+
+#undef TOKEN_TYPE
+#undef TOKEN_KEYWORD
@@ -4,8 +4,6 @@ namespace Chronos
 {
 	using namespace NodeValues;
 
-	std::unordered_map<std::string, ValueType> Scope;
-
 	ValueType TypeChecker::check_type_num(TokenType type)
 	{
 		switch (type)
@@ -19,19 +17,8 @@ namespace Chronos
 		}
 	}
 
-	ValueType TypeChecker::check_type_logic_binop(BinOp& binop)
+	ValueType TypeChecker::arith_type(ValueType ltype, ValueType rtype)
 	{
-		check_type(binop.left);
-		check_type(binop.right);
-
-		return ValueType::INT;
-	}
-
-	ValueType TypeChecker::check_type_arith_binop(BinOp& binop)
-	{
-		ValueType ltype = check_type(binop.left);
-		ValueType rtype = check_type(binop.right);
-
 		if (ltype == ValueType::POINTER || rtype == ValueType::POINTER) return ValueType::POINTER;
 		if (ltype == ValueType::FLOAT || rtype == ValueType::FLOAT) return ValueType::FLOAT;
 		if (ltype == ValueType::INT || rtype == ValueType::INT) return ValueType::INT;
@@ -39,9 +26,9 @@ namespace Chronos
 		else return ValueType::POINTER;
 	}
 
-	ValueType TypeChecker::check_type_binop(BinOp& binop)
+	bool TypeChecker::is_logic_op(TokenType type)
 	{
-		switch (binop.type)
+		switch (type)
 		{
 		case TokenType::KW_AND:
 		case TokenType::KW_OR:
@@ -50,12 +37,12 @@ namespace Chronos
 		case TokenType::LESS_EQ:
 		case TokenType::GREATER:
 		case TokenType::GREATER_EQ:
-			return check_type_logic_binop(binop);
+			return true;
 		case TokenType::ADD:
 		case TokenType::SUB:
 		case TokenType::MUL:
 		case TokenType::DIV:
-			return check_type_arith_binop(binop);
+			return false;
 
 		default:
 			ASSERT(false, "this type of binop is not supported");
@@ -63,9 +50,18 @@ namespace Chronos
 		}
 	}
 
-	ValueType TypeChecker::check_type_assign(AssignOp& op)
+	// the check_type_* helpers expect the operands to be typed already
+	ValueType TypeChecker::check_type_binop(BinOp& binop)
 	{
-		ValueType type = check_type(op.expr);
+		if (is_logic_op(binop.type)) return ValueType::INT;
+		return arith_type(binop.left->value_type, binop.right->value_type);
+	}
+
+	uint32_t TypeChecker::declare(SymbolID var, ValueType type)
+	{
+		bool created = false;
+		uint32_t symbol = m_Symbols.declare(var, type, &created);
+		if (!created) return symbol;
 
 		switch (type)
 		{
@@ -80,33 +76,46 @@ namespace Chronos
 			break;
 		}
 
-		//TODO: what is with reassign
-		Scope.emplace(std::make_pair(op.var, type));
-		return type;
+		return symbol;
 	}
 
-	ValueType TypeChecker::check_type_access(std::string var)
+	uint32_t TypeChecker::resolve(SymbolID var)
 	{
-		//TODO: check if exists
-		return Scope.at(var);
+		uint32_t symbol = m_Symbols.lookup(var);
+		ASSERT(symbol != SymbolTable::NO_SYMBOL, "access of an undefined variable");
+		return symbol;
+	}
+
+	ValueType TypeChecker::check_type_assign(AssignOp& op)
+	{
+		return m_Symbols[declare(op.var, op.expr->value_type)].type;
+	}
+
+	ValueType TypeChecker::check_type_access(SymbolID var)
+	{
+		return m_Symbols[resolve(var)].type;
 	}
 
 	ValueType TypeChecker::check_type_unryop(UnryOp& op)
 	{
-		check_type(op.right);
 		if (op.type == TokenType::NOT) return ValueType::INT;
-		return check_type(op.right);
+		return op.right->value_type;
 	}
 
-	ValueType TypeChecker::check_type(Node* node)
+	ValueType TypeChecker::check_type(Node* root)
 	{
-		if (!node) return ValueType::NONE;
+		if (!root) return ValueType::NONE;
 
+		for_each_post_order(root, [this](Node* node) { check_type_node(node); });
+		return root->value_type;
+	}
+
+	void TypeChecker::check_type_node(Node* node)
+	{
 		switch (node->type)
 		{
 		case NodeType::ROOT:
 			node->value_type = ValueType::NONE;
-			for (Node* n : std::get<Root>(node->value).nodes) check_type(n);
 			break;
 
 		case NodeType::NUM:
@@ -116,7 +125,7 @@ namespace Chronos
 			node->value_type = check_type_binop(std::get<BinOp>(node->value));
 			break;
 		case NodeType::ACCESS:
-			node->value_type = check_type_access(std::get<std::string>(node->value));
+			node->value_type = check_type_access(std::get<SymbolID>(node->value));
 			break;
 		case NodeType::ASSIGN:
 			node->value_type = check_type_assign(std::get<AssignOp>(node->value));
@@ -125,8 +134,44 @@ namespace Chronos
 			node->value_type = check_type_unryop(std::get<UnryOp>(node->value));
 			break;
 		}
+	}
 
-		return node->value_type;
+	void TypeChecker::check_type(FlatAST& ast)
+	{
+		// operands always come before their node, so one forward pass types everything
+		// and replaces the names of ACCESS and ASSIGN nodes by their symbol
+		for (uint32_t i = 0; i < ast.size(); i++)
+		{
+			ValueType type = ValueType::NONE;
+
+			switch (ast.kinds[i])
+			{
+			case NodeType::NUM:
+				type = check_type_num(ast.ops[i]);
+				break;
+			case NodeType::BINOP:
+				if (is_logic_op(ast.ops[i])) type = ValueType::INT;
+				else type = arith_type(ast.types[ast.lhs[i]], ast.types[ast.rhs[i]]);
+				break;
+			case NodeType::ACCESS:
+				ast.values[i].symbol = resolve(ast.values[i].symbol);
+				type = m_Symbols[ast.values[i].symbol].type;
+				break;
+			case NodeType::ASSIGN:
+				ast.values[i].symbol = declare(ast.values[i].symbol, ast.types[ast.lhs[i]]);
+				type = m_Symbols[ast.values[i].symbol].type;
+				break;
+			case NodeType::UNRYOP:
+				if (ast.ops[i] == TokenType::NOT) type = ValueType::INT;
+				else type = ast.types[ast.lhs[i]];
+				break;
+			case NodeType::ROOT:
+				ASSERT(false, "ROOT node in a flat AST");
+				break;
+			}
+
+			ast.types[i] = type;
+		}
 	}
 
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Parser.h"
+#include "FlatAST.h"
+#include "SymbolTable.h"
 #include "Debug.h"
 
 namespace Chronos
@@ -13,21 +15,33 @@ namespace Chronos
 		uint32_t m_FloatCount = 0;
 		uint32_t m_PtrCount = 0;
 
+		SymbolTable m_Symbols;
+
+		static ValueType arith_type(ValueType ltype, ValueType rtype);
+		uint32_t declare(SymbolID var, ValueType type);
+		uint32_t resolve(SymbolID var);
+
 		ValueType check_type_unryop(NodeValues::UnryOp& op);
 		ValueType check_type_assign(NodeValues::AssignOp& op);
-		ValueType check_type_access(std::string var);
+		ValueType check_type_access(SymbolID var);
 		ValueType check_type_num(TokenType type);
 		ValueType check_type_binop(NodeValues::BinOp& binop);
-		ValueType check_type_arith_binop(NodeValues::BinOp& binop);
-		ValueType check_type_logic_binop(NodeValues::BinOp& binop);
+		void check_type_node(Node* node);
 
 	public:
+		static bool is_logic_op(TokenType type);
+
 		inline uint32_t get_int_count() { return m_IntCount; }
 		inline uint32_t get_float_count() { return m_FloatCount; }
 		inline uint32_t get_ptr_count() { return m_PtrCount; }
 
-		uint32_t get_alloc_size() { return 4 * (m_IntCount + m_FloatCount + m_PtrCount); }
+		uint32_t get_alloc_size() { return m_Symbols.frame_size(); }
+
+		// symbols of every variable checked so far, indexed by the resolved FlatAST values
+		SymbolTable& get_symbols() { return m_Symbols; }
 
-		ValueType check_type(Node* node);
+		ValueType check_type(Node* root);
+		// resolves ACCESS and ASSIGN values from names to symbol indices in place
+		void check_type(FlatAST& ast);
 	};
 }
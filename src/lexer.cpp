@@ -1,80 +1,130 @@
 #include "Lexer.h"
+#include "CharClass.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <string>
 #include <stdio.h>
 #include <ctype.h>
 #include <unordered_map>
+#include <vector>
 
 namespace Chronos
 {
-	const std::string LETTERS = "_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	std::string to_string(const Span& span)
+	{
+		std::string s = "file: ";
+		s += std::to_string(span.file_nr) + ", begin: " + std::to_string(span.begin) + ", length: " + std::to_string(span.length);
+		return s;
+	}
+
+	struct TokenInfo
+	{
+		const char* name;
+		std::string_view spelling;
+	};
+
+	// indexed by TokenType, spelling is empty for everything but keywords
+	constexpr TokenInfo TOKEN_INFO[] =
+	{
+		#define TOKEN_TYPE(a) { #a, "" },
+		#define TOKEN_KEYWORD(a, s) { #a, s },
+		#include "Token.h"
+	};
+
+	constexpr std::size_t TOKEN_COUNT = sizeof(TOKEN_INFO) / sizeof(TOKEN_INFO[0]);
+	static_assert(TOKEN_COUNT == (std::size_t) TokenType::NONE + 1, "TOKEN_INFO out of sync with TokenType");
+
+	struct KeywordSlot
+	{
+		std::string_view spelling;
+		TokenType type = TokenType::NONE;
+	};
+
+	constexpr std::size_t count_keywords()
+	{
+		std::size_t count = 0;
+		for (const TokenInfo& info : TOKEN_INFO) if (!info.spelling.empty()) ++count;
+		return count;
+	}
+
+	constexpr std::size_t next_pow2(std::size_t n)
+	{
+		std::size_t p = 1;
+		while (p < n) p <<= 1;
+		return p;
+	}
+
+	constexpr std::size_t KEYWORD_SLOTS = next_pow2(2 * count_keywords());
 
-	bool is_space(char c)
+	constexpr uint32_t keyword_hash(std::string_view s, uint32_t seed)
 	{
-		switch (c)
+		uint32_t h = seed ^ (uint32_t) s.size();
+		for (char c : s) h = (h ^ (uint8_t) c) * 16777619u;
+		h ^= h >> 16;
+		return h & (KEYWORD_SLOTS - 1);
+	}
+
+	constexpr bool is_perfect_seed(uint32_t seed)
+	{
+		bool used[KEYWORD_SLOTS] = {};
+		for (const TokenInfo& info : TOKEN_INFO)
 		{
-		case ' ':
-		case '\t':
-		case '\r':
-		case '\n':
-			return true;
-		default:
-			return false;
+			if (info.spelling.empty()) continue;
+			uint32_t slot = keyword_hash(info.spelling, seed);
+			if (used[slot]) return false;
+			used[slot] = true;
 		}
+		return true;
 	}
 
-	bool is_letter(char c)
+	constexpr uint32_t find_keyword_seed()
 	{
-		int pos = LETTERS.find(c);
-		return (pos != std::string::npos);
+		uint32_t seed = 2166136261u;
+		while (!is_perfect_seed(seed)) ++seed;
+		return seed;
 	}
 
-	bool is_digit(char c)
+	constexpr uint32_t KEYWORD_SEED = find_keyword_seed();
+
+	constexpr std::array<KeywordSlot, KEYWORD_SLOTS> make_keyword_table()
 	{
-		switch (c)
+		std::array<KeywordSlot, KEYWORD_SLOTS> table = {};
+		for (std::size_t i = 0; i < TOKEN_COUNT; i++)
 		{
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			return true;
-		default: return false;
+			if (TOKEN_INFO[i].spelling.empty()) continue;
+			table[keyword_hash(TOKEN_INFO[i].spelling, KEYWORD_SEED)] = { TOKEN_INFO[i].spelling, (TokenType) i };
 		}
+		return table;
 	}
 
-	std::string to_string(const Position& pos)
+	constexpr std::array<KeywordSlot, KEYWORD_SLOTS> KEYWORD_TABLE = make_keyword_table();
+
+	constexpr std::size_t max_keyword_length()
 	{
-		std::string s = "indx: ";
-		s += std::to_string(pos.index) + ", line: " + std::to_string(pos.line) + ", column: " + std::to_string(pos.column);
-		return s;
+		std::size_t length = 0;
+		for (const TokenInfo& info : TOKEN_INFO) if (info.spelling.size() > length) length = info.spelling.size();
+		return length;
 	}
 
-	TokenType get_tokentype(const char* s)
+	constexpr std::size_t MAX_KEYWORD_LENGTH = max_keyword_length();
+
+	TokenType get_tokentype(std::string_view s)
 	{
-		if (s == "&&") return TokenType::KW_AND;
-		else if (s == "||") return TokenType::KW_OR;
-		else return TokenType::NONE;
+		if (s.size() > MAX_KEYWORD_LENGTH) return TokenType::NONE;
+
+		const KeywordSlot& slot = KEYWORD_TABLE[keyword_hash(s, KEYWORD_SEED)];
+		if (slot.spelling == s) return slot.type;
+		return TokenType::NONE;
 	}
 
 	std::string to_string(const TokenType t)
 	{
-		switch (t)
-		{
-			#define TOKEN_TYPE(a) case TokenType::a: return #a;
-			#include "Token.h"
-		default:
-			ASSERT(false, "to_string not defined for tokentype");
-			exit(-1);
-		}
+		ASSERT((std::size_t) t < TOKEN_COUNT, "to_string not defined for tokentype");
+		return TOKEN_INFO[(std::size_t) t].name;
 	}
 
-	std::string to_string(const Token& t)
+	std::string to_string(const Token& t, const StringTable* strings)
 	{
 		std::string s;
 
@@ -82,17 +132,18 @@ namespace Chronos
 		{
 		case TokenType::INT:
 			s += "INT(";
-			s += std::to_string(std::get<int>(t.value));
+			s += std::to_string(t.as_int());
 			s += ")";
 			break;
 		case TokenType::FLOAT:
 			s += "FLOAT(";
-			s += std::to_string(std::get<float>(t.value));
+			s += std::to_string(t.as_float());
 			s += ")";
 			break;
 		case TokenType::ID:
 			s += "ID(";
-			s += std::get<std::string>(t.value);
+			if (strings) s += strings->get(t.as_symbol());
+			else s += "#" + std::to_string(t.as_symbol());
 			s += ")";
 			break;
 
@@ -102,51 +153,52 @@ namespace Chronos
 		}
 
 #ifdef PRINT_POS
-		s += " start: " + to_string(t.start_pos);
-		s += ", end: " + to_string(t.end_pos);
+		s += " " + to_string(t.span());
 #endif
 
 		return s;
 	}
 
-	void Lexer::load_text(const char* text, size_t size)
+	void Lexer::load_text(const char* text, size_t size, size_t file_nr)
 	{
+		m_FileNr = file_nr;
 		m_TextSize = size;
 		m_Text = text;
 		m_CharPtr = text;
 	}
 
 
+	char Lexer::current_char()
+	{
+		if (m_CharPtr == nullptr || m_Index >= m_TextSize) return '\0';
+		return *m_CharPtr;
+	}
+
 	void Lexer::advance()
 	{
 		if (m_CharPtr == nullptr) return;
-		switch (*m_CharPtr)
-		{
-		case '\n':
-			++m_Line;
-			m_Column = 0;
-			break;
-
-		default:
-			++m_Column;
-			break;
-		}
-
 
 		if (m_Index >= m_TextSize)
 		{
 			m_CharPtr = nullptr;
+			return;
 		}
-		else
-		{
-			++m_CharPtr;
-			++m_Index;
-		}
+
+		++m_CharPtr;
+		++m_Index;
+	}
+
+	void Lexer::advance_by(std::size_t count)
+	{
+		if (m_CharPtr == nullptr || count == 0) return;
+
+		m_CharPtr += count;
+		m_Index += count;
 	}
 
-	Position Lexer::get_current_pos()
+	Span Lexer::span_from(size_t begin)
 	{
-		return Position({ m_Index, m_Line, m_Column });
+		return { (uint32_t) m_FileNr, (uint32_t) begin, (uint32_t) (m_Index - begin) };
 	}
 
 	void Lexer::set_error(Error e)
@@ -167,104 +219,233 @@ namespace Chronos
 
 	void Lexer::parse_tokens()
 	{
-		while (m_CharPtr)
+		while (std::optional<Token> token = next_token())
+		{
+			m_Tokens.push_back(*token);
+		}
+	}
+
+	// chunks may only start right after whitespace or ';', no token (and no
+	// lexer error recovery) ever spans across such a boundary
+	size_t next_chunk_boundary(const char* text, size_t size, size_t from)
+	{
+		for (size_t i = from; i < size; i++)
+		{
+			if (is_space(text[i]) || text[i] == ';') return i + 1;
+		}
+		return size;
+	}
+
+	struct LexedChunk
+	{
+		size_t begin = 0;
+		size_t size = 0;
+
+		StringTable strings;
+		std::deque<Token> tokens;
+		Error error;
+		bool has_error = false;
+
+		// where the chunk's lexer stopped, only short of 'size' after an illegal char
+		size_t end_index = 0;
+		bool end_valid = true;
+	};
+
+	// lexes the buffer in independent chunks on 'pool' and stitches the result
+	// together, the tokens, symbol ids and error are the same as parse_tokens()
+	void Lexer::parse_tokens(ThreadPool& pool)
+	{
+		size_t remaining = m_TextSize - m_Index;
+		size_t chunk_count = std::min(pool.size(), remaining / PARALLEL_MIN_CHUNK);
+
+		if (chunk_count <= 1 || m_CharPtr == nullptr)
+		{
+			parse_tokens();
+			return;
+		}
+
+		std::vector<LexedChunk> chunks(chunk_count);
+		size_t begin = m_Index;
+		for (size_t i = 0; i < chunk_count; i++)
+		{
+			size_t end = m_TextSize;
+			if (i + 1 < chunk_count) end = next_chunk_boundary(m_Text, m_TextSize, std::max(begin, m_Index + remaining * (i + 1) / chunk_count));
+
+			chunks[i].begin = begin;
+			chunks[i].size = end - begin;
+			begin = end;
+		}
+
+		for (LexedChunk& chunk : chunks)
+		{
+			pool.submit([this, &chunk]()
+			{
+				Lexer lexer(chunk.strings);
+				lexer.load_text(m_Text + chunk.begin, chunk.size, m_FileNr);
+				lexer.parse_tokens();
+
+				chunk.tokens = lexer.take_tokens();
+				chunk.has_error = lexer.has_error();
+				chunk.error = lexer.get_error();
+				chunk.end_index = lexer.m_Index;
+				chunk.end_valid = lexer.m_CharPtr != nullptr;
+			});
+		}
+		pool.wait();
+
+		// interning every chunk's names in chunk order hands out the same ids
+		// as one lexer walking the whole buffer
+		std::vector<SymbolID> symbols;
+		for (LexedChunk& chunk : chunks)
+		{
+			symbols.resize(chunk.strings.size());
+			for (size_t i = 0; i < symbols.size(); i++) symbols[i] = m_Strings->intern(chunk.strings.get((SymbolID) i));
+
+			for (Token& t : chunk.tokens)
+			{
+				t.begin += (uint32_t) chunk.begin;
+				if (t.type == TokenType::ID) t.value.symbol = symbols[t.value.symbol];
+				m_Tokens.push_back(t);
+			}
+
+			if (chunk.has_error)
+			{
+				chunk.error.span.begin += (uint32_t) chunk.begin;
+				set_error(chunk.error);
+			}
+
+			if (chunk.end_index < chunk.size)
+			{
+				m_Index = chunk.begin + chunk.end_index;
+				m_CharPtr = chunk.end_valid ? m_Text + m_Index : nullptr;
+				return;
+			}
+		}
+
+		advance_by(m_TextSize - m_Index);
+	}
+
+	bool same_token(const Token& a, const Token& b)
+	{
+		if (a.type != b.type || a.begin != b.begin || a.length != b.length) return false;
+
+		switch (a.type)
+		{
+		case TokenType::INT: return a.as_int() == b.as_int();
+		case TokenType::FLOAT: return a.as_float() == b.as_float();
+		case TokenType::ID: return a.as_symbol() == b.as_symbol();
+		default: return true;
+		}
+	}
+
+	// the earlier tokens are someone else's, so is their error
+	void Lexer::seek(size_t offset)
+	{
+		m_HasError = false;
+		m_Index = offset;
+		m_CharPtr = m_Text + offset;
+	}
+
+	std::optional<Token> Lexer::next_token()
+	{
+		while (m_CharPtr && m_Index < m_TextSize)
 		{
 			char c = *m_CharPtr;
-			if (c == NULL) return;
+			if (c == '\0') return {};
 
 			if (is_space(c))
 			{
-				advance();
+				advance_by(scan_spaces(m_CharPtr, m_TextSize - m_Index));
 				continue;
 			}
 			else if (is_digit(c))
 			{
-				m_Tokens.push_back(make_number());
-				continue;
+				return make_number();
 			}
 			else if (is_letter(c))
 			{
-				m_Tokens.push_back(make_identifier());
-				continue;
+				return make_identifier();
 			}
 
-			Position pos = get_current_pos();
+			size_t start = m_Index;
+			TokenType type = TokenType::NONE;
 
 			switch (c)
 			{
 			case '+':
-				m_Tokens.push_back(Token(TokenType::ADD, { 0 }, pos));
+				type = TokenType::ADD;
 				break;
 			case '&':
 			{
 				auto token = make_and();
 				if (token.index() == (int)LexerRes::ERROR) set_error(std::get<Error>(token));
-				else m_Tokens.push_back(std::get<Token>(token));
-				break;
+				else return std::get<Token>(token);
+				continue;
 			}
 			case '|':
 			{
 				auto token = make_or();
 				if (token.index() == (int)LexerRes::ERROR) set_error(std::get<Error>(token));
-				else m_Tokens.push_back(std::get<Token>(token));
-				break;
+				else return std::get<Token>(token);
+				continue;
 			}
 			case '-':
-				m_Tokens.push_back(Token(TokenType::SUB, { 0 }, pos));
+				type = TokenType::SUB;
 				break;
 			case '!':
-				m_Tokens.push_back(Token(TokenType::NOT, { 0 }, pos));
+				type = TokenType::NOT;
 				break;
 			case '*':
-				m_Tokens.push_back(Token(TokenType::MUL, { 0 }, pos));
+				type = TokenType::MUL;
 				break;
 			case '/':
-				m_Tokens.push_back(Token(TokenType::DIV, { 0 }, pos));
+				type = TokenType::DIV;
 				break;
 			case '(':
-				m_Tokens.push_back(Token(TokenType::LROUND, { 0 }, pos));
+				type = TokenType::LROUND;
 				break;
 			case ')':
-				m_Tokens.push_back(Token(TokenType::RROUND, { 0 }, pos));
+				type = TokenType::RROUND;
 				break;
-			case '=':
-				m_Tokens.push_back(make_equal());
+			case ';':
+				type = TokenType::SEMICLN;
 				break;
+			case '=':
+				return make_equal();
 			case '<':
-				m_Tokens.push_back(make_less());
-				break;
+				return make_less();
 			case '>':
-				m_Tokens.push_back(make_greater());
-				break;
+				return make_greater();
 
 			default:
-				m_HasError = true;
 				advance();
-				Position current_pos = get_current_pos();
 				std::string details = "found char: ";
 				details.push_back(c);
-				m_Error = { ErrorType::ILLEGAL_CHAR, details, pos, current_pos};
-				return;
+				set_error({ ErrorType::ILLEGAL_CHAR, details, span_from(start) });
+				m_CharPtr = nullptr;
+				return {};
 			}
 
 			advance();
+			return Token(type, { 0 }, span_from(start));
 		}
+
+		return {};
 	}
 
 	std::optional<Error> Lexer::expect_char(const char c)
 	{
-		if (*m_CharPtr != c)
+		if (current_char() != c)
 		{
-			Position start = get_current_pos();
+			size_t start = m_Index;
 
 			std::string details = "expected '";
 			details.push_back(c);
 			details += "', found: ";
-			details.push_back(*m_CharPtr);
+			details.push_back(current_char());
 			advance();
 
-			Position end = get_current_pos();
-			return Error{ ErrorType::ILLEGAL_CHAR, details, start, end };
+				return Error{ ErrorType::ILLEGAL_CHAR, details, span_from(start) };
 		}
 
 		return {};
@@ -272,144 +453,119 @@ namespace Chronos
 
 	Token Lexer::make_number()
 	{
-		std::string num;
-		Position start = get_current_pos();
-		bool has_dot = false;
+		size_t start = m_Index;
+		const char* num_start = m_CharPtr;
 
-		while (m_CharPtr && (is_digit(*m_CharPtr) || *m_CharPtr == '.'))
+		std::size_t length = scan_digits(m_CharPtr, m_TextSize - m_Index);
+		bool has_dot = m_Index + length < m_TextSize && m_CharPtr[length] == '.';
+		if (has_dot)
 		{
-			if (*m_CharPtr == '.' && !has_dot)
-			{
-				has_dot = true;
-			}
-			else if (*m_CharPtr == '.' && has_dot)
-			{
-				break;
-			}
-
-			num += *m_CharPtr;
-			advance();
+			++length;
+			length += scan_digits(m_CharPtr + length, m_TextSize - m_Index - length);
 		}
 
-		Position end = get_current_pos();
+		advance_by(length);
+		std::string num(num_start, length);
 
 		if (has_dot)
 		{
-			TokenValue value;
-			value = std::stof(num);
-			return Token(TokenType::FLOAT, value, start, end);
+			return Token(TokenType::FLOAT, std::stof(num), span_from(start));
 		}
 		else
 		{
-			TokenValue value;
-			value = std::stoi(num);
-			return Token(TokenType::INT, value, start, end);
+			return Token(TokenType::INT, std::stoi(num), span_from(start));
 		}
 	}
 
 	Token Lexer::make_identifier()
 	{
-		std::string id = "";
-		Position start = get_current_pos();
-
-		std::string allowed = LETTERS;
-
-		while (m_CharPtr && (allowed.find(*m_CharPtr) != std::string::npos))
-		{
-			id.push_back(*m_CharPtr);
-			advance();
-		}
+		size_t start = m_Index;
+		const char* id_start = m_CharPtr;
 
-		TokenType type = get_tokentype(id.c_str());
-		Position end = get_current_pos();
+		std::size_t length = scan_letters(m_CharPtr, m_TextSize - m_Index);
+		advance_by(length);
 
+		std::string_view id(id_start, length);
+		TokenType type = get_tokentype(id);
 		if (type != TokenType::NONE)
 		{
-			return Token(type, { 0 }, start, end);
+			return Token(type, { 0 }, span_from(start));
 		}
 		else
 		{
-			return Token(TokenType::ID, id, start, end);
+			return Token(TokenType::ID, m_Strings->intern(id), span_from(start));
 		}
 	}
 
 	Token Lexer::make_equal()
 	{
-		Position start = get_current_pos();
+		size_t start = m_Index;
 		TokenType type = TokenType::ASSIGN;
 		advance();
 
-		if (m_CharPtr && *m_CharPtr == '=')
+		if (current_char() == '=')
 		{
 			advance();
 			type = TokenType::EQUAL;
 		}
 
-		Position end = get_current_pos();
-
-		return { type, 0, start, end };
+		return Token(type, 0, span_from(start));
 	}
 
 	Token Lexer::make_less()
 	{
-		Position start = get_current_pos();
+		size_t start = m_Index;
 		TokenType type = TokenType::LESS;
 		advance();
 
-		if (m_CharPtr && *m_CharPtr == '=')
+		if (current_char() == '=')
 		{
 			advance();
 			type = TokenType::LESS_EQ;
 		}
 
-		Position end = get_current_pos();
-
-		return { type, 0, start, end };
+		return Token(type, 0, span_from(start));
 	}
 
 	Token Lexer::make_greater()
 	{
-		Position start = get_current_pos();
+		size_t start = m_Index;
 		TokenType type = TokenType::GREATER;
 		advance();
 
-		if (m_CharPtr && *m_CharPtr == '=')
+		if (current_char() == '=')
 		{
 			advance();
 			type = TokenType::GREATER_EQ;
 		}
 
-		Position end = get_current_pos();
-
-		return { type, 0, start, end };
+		return Token(type, 0, span_from(start));
 	}
 
 	LexerResult Lexer::make_and()
 	{
-		Position start = get_current_pos();
+		size_t start = m_Index;
 
 		std::optional<Error> e;
 		if (e = expect_char('&')) return e.value();
 		advance();
 		if (e = expect_char('&')) return e.value();
+		advance();
 
-		Position end = get_current_pos();
-
-		return Token(TokenType::KW_AND, 0, start, end);
+		return Token(TokenType::KW_AND, 0, span_from(start));
 	}
 
 	LexerResult Lexer::make_or()
 	{
-		Position start = get_current_pos();
+		size_t start = m_Index;
 
 		std::optional<Error> e;
 		if (e = expect_char('|')) return e.value();
 		advance();
 		if (e = expect_char('|')) return e.value();
+		advance();
 
-		Position end = get_current_pos();
-
-		return Token(TokenType::KW_OR, 0, start, end);
+		return Token(TokenType::KW_OR, 0, span_from(start));
 	}
 
 	void Lexer::print_tokens()
@@ -417,7 +573,7 @@ namespace Chronos
 		std::cout << "size: " << m_Tokens.size() << "\n";
 		for (Token& t : m_Tokens)
 		{
-			std::cout << to_string(t) << ", ";
+			std::cout << to_string(t, m_Strings) << ", ";
 		}
 		std::cout << "\n";
 	}
@@ -426,9 +582,8 @@ namespace Chronos
 		m_HasError = false;
 
 		m_Tokens.clear();
-		m_Line = 0;
-		m_Column = 0;
 		m_Index = 0;
+		m_FileNr = 0;
 
 		m_TextSize = 0;
 		m_Text = nullptr;
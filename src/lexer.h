@@ -8,11 +8,13 @@
 
 #include "Debug.h"
 #include "Error.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
 
 namespace Chronos
 {
 
-	enum class TokenType
+	enum class TokenType : uint8_t
 	{
 		#define TOKEN_TYPE(a) a,
 		#include "Token.h"
@@ -46,30 +48,59 @@ namespace Chronos
 		*/
 	};
 
-	using TokenValue = std::variant<int, float, std::string>;
+	// payload of INT, FLOAT and ID tokens, the token type says which one is set
+	union TokenValue
+	{
+		int int_value;
+		float float_value;
+		SymbolID symbol;
+
+		TokenValue(int v) : int_value(v) {}
+		TokenValue(float v) : float_value(v) {}
+		TokenValue(SymbolID v) : symbol(v) {}
+	};
 
 	struct Token
 	{
 		TokenType type;
+		uint16_t file_nr;
 		TokenValue value;
 
-		Position start_pos;
-		Position end_pos;
+		uint32_t begin;
+		uint32_t length;
+
+		Token()
+			: type(TokenType::NONE), file_nr(0), value(0), begin(0), length(0) {}
+
+		Token(TokenType t, TokenValue v, Span span)
+			: type(t), file_nr((uint16_t) span.file_nr), value(v), begin(span.begin), length(span.length) {}
+
+		Span span() const { return { file_nr, begin, length }; }
 
-		Token(TokenType t, TokenValue v, Position a, Position b)
-			: type(t), value(v), start_pos(a), end_pos(b) {}
+		int as_int() const
+		{
+			ASSERT(type == TokenType::INT, "token is not an INT");
+			return value.int_value;
+		}
+
+		float as_float() const
+		{
+			ASSERT(type == TokenType::FLOAT, "token is not a FLOAT");
+			return value.float_value;
+		}
 
-		Token(TokenType t, TokenValue v, Position pos)
-			: type(t), value(v), start_pos(pos), end_pos(pos) 
+		SymbolID as_symbol() const
 		{
-			end_pos.column++;
-			end_pos.index++;
+			ASSERT(type == TokenType::ID, "token is not an ID");
+			return value.symbol;
 		}
 	};
 
+	static_assert(sizeof(Token) == 16, "tokens are kept at 16 bytes");
+
 	std::string to_string(const TokenType t);
-	std::string to_string(const Token& t);
-	std::string to_string(const Position& pos);
+	std::string to_string(const Token& t, const StringTable* strings = nullptr);
+	std::string to_string(const Span& span);
 
 	enum class LexerRes : uint8_t
 	{
@@ -79,6 +110,16 @@ namespace Chronos
 
 	using LexerResult = std::variant<Error, Token>;
 
+	// replaces 'removed' bytes at 'offset' with 'inserted'
+	struct TextEdit
+	{
+		size_t offset = 0;
+		size_t removed = 0;
+		std::string_view inserted;
+	};
+
+	bool same_token(const Token& a, const Token& b);
+
 	class Lexer
 	{
 		private:
@@ -86,17 +127,20 @@ namespace Chronos
 			Error m_Error;
 			bool m_HasError = false;
 
-			size_t m_Line = 0;
-			size_t m_Column = 0;
 			size_t m_Index = 0;
+			size_t m_FileNr = 0;
 
 			std::size_t m_TextSize = 0;
 			const char *m_Text = nullptr;
 			const char *m_CharPtr = nullptr;
 
+			StringTable* m_Strings = nullptr;
 
+
+			char current_char();
 			void advance();
-			Position get_current_pos();
+			void advance_by(std::size_t count);
+			Span span_from(size_t begin);
 
 			void set_error(Error e);
 
@@ -111,16 +155,29 @@ namespace Chronos
 
 		public:
 
-			Lexer() {}
+			Lexer(StringTable& strings)
+				: m_Strings(&strings) {}
 
-			std::deque<Token> get_tokens()
+			const std::deque<Token>& get_tokens()
 			{
 				return m_Tokens;
 			}
 
-			void load_text(const char* text, size_t size);
+			std::deque<Token> take_tokens()
+			{
+				return std::move(m_Tokens);
+			}
+
+			void load_text(const char* text, size_t size, size_t file_nr = 0);
+
+			// buffers smaller than this are never split for parallel lexing
+			static const size_t PARALLEL_MIN_CHUNK = 1 << 20;
 
 			void parse_tokens();
+			void parse_tokens(ThreadPool& pool);
+			// lexes the loaded text from 'offset' on, for IncrementalLexer
+			void seek(size_t offset);
+			std::optional<Token> next_token();
 			void print_tokens();
 
 			void clear();
@@ -1,11 +1,16 @@
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <cstdint>
+#include <optional>
+#include <vector>
 
 
 #include "Lexer.h"
 #include "Parser.h"
 #include "Compiler.h"
+#include "AstCache.h"
+#include "PassManager.h"
 
 extern "C"
 {
@@ -13,8 +18,190 @@ extern "C"
 }
 
 
-int main()
+static size_t statement_count(const Chronos::ParseResult& res)
 {
+	if (res.index() == (int) Chronos::ParseRes::ERROR) return 0;
+	return std::get<Chronos::NodeValues::Root>(std::get<Chronos::Node*>(res)->value).nodes.size();
+}
+
+// runs the peephole rules over the generated code and writes it out
+static void emit(Chronos::Compiler& compiler, Chronos::PassManager& passes, bool peephole)
+{
+	compiler.set_peephole(peephole);
+
+	if (peephole)
+	{
+		passes.run("peephole", "rewrites", [&] { return compiler.peephole(); });
+
+		for (auto& [rule, hits] : compiler.peephole_hits())
+		{
+			std::string name = "peephole ";
+			passes.add_counter((name + rule).c_str(), hits);
+		}
+	}
+
+	passes.run("emit", "instructions", [&] { size_t count = compiler.instruction_count(); compiler.close(); return count; });
+}
+
+// compiles every file in 'paths' into a single program, the sources are
+// memory-mapped and lexed in place. With 'use_cache' a program that was
+// compiled before is taken from the AST cache without lexing, parsing or
+// type checking it. Every stage runs as a pass of 'passes', which measures it
+int compile_files(const std::vector<const char*>& paths, Chronos::PassManager& passes, bool separate_lexing, bool use_cache, bool cse, bool peephole)
+{
+	Chronos::FileManager fm;
+	Chronos::StringTable strings;
+	Chronos::Arena arena;
+	Chronos::Lexer lexer(strings);
+	Chronos::Parser parser(arena);
+	Chronos::Compiler compiler;
+	Chronos::AstCache cache;
+	// only started once a file is big enough to be split across threads
+	std::optional<Chronos::ThreadPool> pool;
+
+	for (const char* path : paths)
+	{
+		if (!fm.map_file(path))
+		{
+			std::cout << "error: could not open " << path << "\n";
+			return 1;
+		}
+	}
+
+	uint64_t key = Chronos::AstCache::hash_sources(fm.get_files());
+	Chronos::FlatAST ast;
+	Chronos::SymbolTable symbols;
+
+	bool cached = false;
+	if (use_cache) passes.run("cache load", "nodes", [&] { cached = cache.load(key, ast, symbols); return ast.size(); });
+
+	if (!cached)
+	{
+		Chronos::Node* root = Chronos::make_root(arena);
+
+		for (size_t i = 0; i < fm.get_files().size(); i++)
+		{
+			std::string_view text = fm.get_files()[i].view();
+			lexer.load_text(text.data(), text.size(), i);
+
+			// big inputs are lexed and parsed up front on all cores, everything else
+			// is streamed unless the lexer has to be measured on its own
+			bool parallel = text.size() >= 2 * Chronos::Lexer::PARALLEL_MIN_CHUNK && std::thread::hardware_concurrency() > 1;
+			if (parallel && !pool) pool.emplace();
+			Chronos::ParseResult res = nullptr;
+
+			if (parallel || separate_lexing)
+			{
+				passes.run("lex", "tokens", [&]
+				{
+					if (parallel) lexer.parse_tokens(*pool);
+					else lexer.parse_tokens();
+					return lexer.get_tokens().size();
+				});
+
+				passes.run("parse", "statements", [&]
+				{
+					parser.load_tokens(lexer.take_tokens());
+					res = parallel ? parser.parse_program(*pool) : parser.parse_program();
+					return statement_count(res);
+				});
+			}
+			else
+			{
+				passes.run("lex+parse", "statements", [&]
+				{
+					parser.load_lexer(lexer);
+					res = parser.parse_program();
+					return statement_count(res);
+				});
+			}
+
+			if (lexer.has_error())
+			{
+				std::cout << lexer.get_error().generate_message(fm.get_files()) << "\n";
+				return 1;
+			}
+
+			if (res.index() == (int) Chronos::ParseRes::ERROR)
+			{
+				std::cout << "error: " << std::get<Chronos::Error>(res).generate_message(fm.get_files()) << "\n";
+				return 1;
+			}
+
+			Chronos::Node* program = std::get<Chronos::Node*>(res);
+			auto& nodes = std::get<Chronos::NodeValues::Root>(program->value).nodes;
+			auto& root_nodes = std::get<Chronos::NodeValues::Root>(root->value).nodes;
+			root_nodes.insert(root_nodes.end(), nodes.begin(), nodes.end());
+
+			lexer.clear();
+		}
+
+		// files can be large, type check and codegen walk the flat form
+		Chronos::TypeChecker checker;
+
+		passes.run("flatten", "nodes", [&] { ast = Chronos::flatten(root); return ast.size(); });
+		passes.run("type check", "nodes", [&] { checker.check_type(ast); return ast.size(); });
+		symbols = std::move(checker.get_symbols());
+
+		// the entry holds what the type checker produced, the passes below run on every compile
+		if (use_cache) passes.run("cache store", "nodes", [&] { cache.store(key, ast, symbols); return ast.size(); });
+	}
+
+	passes.run("fold", "nodes", [&] { Chronos::fold_constants(ast, symbols); return ast.size(); });
+	if (cse) passes.run("cse", "nodes", [&] { Chronos::eliminate_common_subexpressions(ast, symbols); return ast.size(); });
+	passes.run("frame layout", "bytes", [&] { Chronos::layout_frame(ast, symbols); return (size_t) symbols.frame_size(); });
+
+	passes.run("codegen", "instructions", [&] { compiler.compile("Chronos", ast, symbols); return compiler.instruction_count(); });
+	emit(compiler, passes, peephole);
+	return 0;
+}
+
+// -ftime-report prints how long every pass took to stderr,
+// -ftime-report-json=<file> writes the same numbers as JSON,
+// -fcache keeps type checked programs in .chronos_cache to skip the front end next time,
+// -fno-cse computes repeated subexpressions every time,
+// -fno-peephole writes the generated code out without rewriting it
+int compile_command_line(int argc, char** argv)
+{
+	static const std::string JSON_FLAG = "-ftime-report-json=";
+
+	std::vector<const char*> paths;
+	bool time_report = false;
+	bool use_cache = false;
+	bool cse = true;
+	bool peephole = true;
+	std::string json_path;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "-ftime-report") time_report = true;
+		else if (arg == "-fcache") use_cache = true;
+		else if (arg == "-fno-cse") cse = false;
+		else if (arg == "-fno-peephole") peephole = false;
+		else if (arg.compare(0, JSON_FLAG.size(), JSON_FLAG) == 0) json_path = arg.substr(JSON_FLAG.size());
+		else paths.push_back(argv[i]);
+	}
+
+	Chronos::PassManager passes;
+	int result = compile_files(paths, passes, time_report || !json_path.empty(), use_cache, cse, peephole);
+
+	if (time_report) std::cerr << passes.report();
+
+	if (!json_path.empty())
+	{
+		std::ofstream json(json_path);
+		json << passes.report_json();
+	}
+
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1) return compile_command_line(argc, argv);
+
 	//ch_heap* h = alloc_heap();
 
 	//ch_int* ptr = heap_alloc_int(h, 3);
@@ -29,12 +216,14 @@ int main()
 	Chronos::FileManager fm;
 
 	std::string buffer;
-	Chronos::Lexer lexer;
-	Chronos::Parser parser;
+	Chronos::StringTable strings;
+	Chronos::Arena arena;
+	Chronos::Lexer lexer(strings);
+	Chronos::Parser parser(arena);
 	Chronos::Compiler compiler;
 
-	Chronos::NodeValues::Root nodes;
-	Chronos::Node* root = new Chronos::Node({ Chronos::NodeType::ROOT,  nodes });
+	// every line is lowered as soon as it parses, its nodes are not needed afterwards
+	compiler.begin("Chronos");
 
 	while (true)
 	{
@@ -46,34 +235,30 @@ int main()
 		fm.add_line(buffer, "<STDIN>");
 
 		lexer.load_text(buffer.c_str(), buffer.size());
-		lexer.parse_tokens();
-		lexer.print_tokens();
+		parser.load_lexer(lexer);
+		Chronos::ParseResult res = parser.parse_nodes();
 
 		if (lexer.has_error())
 		{
 			std::cout << lexer.get_error().generate_message(fm.get_files()) << "\n";
 		}
 
-		parser.load_tokens(lexer.get_tokens());
-		Chronos::ParseResult res = parser.parse_nodes();
-
 		if (res.index() == (int) Chronos::ParseRes::OK)
 		{
 			Chronos::Node* node = std::get<Chronos::Node*>(res);
-			if (node) std::cout << "result: " << Chronos::to_string(*node) << "\n";
-			std::get<Chronos::NodeValues::Root>(root->value).nodes.push_back(node);
-			//nodes.push_back(node);
-			//compiler.compile("Chronos", nodes);
-
+			if (node)
+			{
+				std::cout << "result: " << Chronos::to_string(*node, strings) << "\n";
+				compiler.compile_statement(node);
+			}
 		}
 		else std::cout << "error: " << std::get<Chronos::Error>(res).generate_message(fm.get_files()) << "\n";
 
 		lexer.clear();
 		fm.clear();
+		arena.reset();
 	}
 
-	compiler.compile("Chronos", root);
-
+	compiler.end();
 	compiler.close();
-	Chronos::delete_nodes(root);
 }
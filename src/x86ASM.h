@@ -1,6 +1,7 @@
 INST_TYPE(PUSH)
 INST_TYPE(MOV)
 INST_TYPE(MOVZX)
+INST_TYPE(LEA)
 INST_TYPE(POP)
 INST_TYPE(NOP)
 INST_TYPE(CALL)
@@ -8,16 +9,26 @@ INST_TYPE(CALL)
 INST_TYPE(ADD)
 INST_TYPE(SUB)
 INST_TYPE(MUL)
+INST_TYPE(IMUL)
 INST_TYPE(DIV)
+INST_TYPE(IDIV)
+INST_TYPE(CDQ)
 INST_TYPE(NEG)
 INST_TYPE(AND)
 INST_TYPE(OR)
 INST_TYPE(XOR)
+INST_TYPE(SHL)
+INST_TYPE(SHR)
+INST_TYPE(SAR)
 
 INST_TYPE(SETE)
+INST_TYPE(SETNE)
 INST_TYPE(SETA)
 INST_TYPE(SETNB)
+INST_TYPE(SETB)
+INST_TYPE(SETBE)
 INST_TYPE(SETNP)
+INST_TYPE(SETP)
 INST_TYPE(SETL)
 INST_TYPE(SETLE)
 INST_TYPE(SETG)
@@ -53,6 +64,14 @@ INST_TYPE(JE)
 INST_TYPE(JNE)
 INST_TYPE(JP)
 INST_TYPE(JZ)
+INST_TYPE(JL)
+INST_TYPE(JLE)
+INST_TYPE(JG)
+INST_TYPE(JGE)
+INST_TYPE(JA)
+INST_TYPE(JNB)
+INST_TYPE(JB)
+INST_TYPE(JBE)
 INST_TYPE(JMP)
 
 INST_TYPE(INT)
@@ -90,4 +109,8 @@ REGISTER(XMM0)
 REGISTER(XMM1)
 REGISTER(XMM2)
 REGISTER(XMM3)
+REGISTER(XMM4)
+REGISTER(XMM5)
+REGISTER(XMM6)
+REGISTER(XMM7)
 REGISTER(NO_REG)
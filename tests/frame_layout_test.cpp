@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Parser.h"
+#include "FlatAST.h"
+#include "TypeChecker.h"
+#include "ConstantFolding.h"
+#include "CommonSubexpressions.h"
+#include "FrameLayout.h"
+
+// layout_frame may only give two symbols the same slot when their live ranges
+// don't overlap. The temporaries of CSE are created after every named symbol,
+// but start in the middle of the program
+static const char* PROGRAMS[] = {
+	"k = 1 && (u = 7); a = u + 1; d = u + 2; p = u * u; q = u * u; r = a + d; b = r + 1; c = b + 1;",
+	"x = 3 || (y = 2); a = y * y; b = a + 1; c = y * y; d = b + c; d;",
+	"a = 1 && (v = 5); b = v + v; c = b * 2; d = v + v; e = c + d; f = v + v; e + f;",
+	"a = 1.5; b = 2 || (a = 2.5); c = a * a; d = c + 1; e = a * a; f = d + e; f;",
+};
+
+static bool check_program(const char* text)
+{
+	Chronos::StringTable strings;
+	Chronos::Arena arena;
+	Chronos::Lexer lexer(strings);
+	Chronos::Parser parser(arena);
+
+	lexer.load_text(text, strlen(text));
+	parser.load_lexer(lexer);
+	Chronos::ParseResult res = parser.parse_program();
+
+	if (lexer.has_error() || res.index() == (int) Chronos::ParseRes::ERROR)
+	{
+		printf("could not parse: %s\n", text);
+		return false;
+	}
+
+	Chronos::FlatAST ast = Chronos::flatten(std::get<Chronos::Node*>(res));
+	Chronos::TypeChecker checker;
+	checker.check_type(ast);
+
+	Chronos::SymbolTable& symbols = checker.get_symbols();
+	Chronos::fold_constants(ast, symbols);
+	Chronos::eliminate_common_subexpressions(ast, symbols);
+	Chronos::layout_frame(ast, symbols);
+
+	std::vector<uint32_t> first(symbols.size(), Chronos::FlatAST::NO_NODE);
+	std::vector<uint32_t> last(symbols.size(), 0);
+	for (uint32_t i = 0; i < ast.size(); i++)
+	{
+		if (ast.kinds[i] != Chronos::NodeType::ASSIGN && ast.kinds[i] != Chronos::NodeType::ACCESS) continue;
+
+		uint32_t symbol = ast.values[i].symbol;
+		if (first[symbol] == Chronos::FlatAST::NO_NODE) first[symbol] = i;
+		last[symbol] = i;
+	}
+
+	bool ok = true;
+	for (uint32_t a = 0; a < symbols.size(); a++)
+	{
+		for (uint32_t b = a + 1; b < symbols.size(); b++)
+		{
+			if (symbols[a].offset == Chronos::Symbol::NO_SLOT || symbols[a].offset != symbols[b].offset) continue;
+			if (last[a] < first[b] || last[b] < first[a]) continue;
+
+			printf("symbols %u [%u, %u] and %u [%u, %u] share [EBP-%d] in: %s\n",
+				a, first[a], last[a], b, first[b], last[b], symbols[a].offset, text);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+int main()
+{
+	int failed = 0;
+	for (const char* program : PROGRAMS)
+	{
+		if (!check_program(program)) failed++;
+	}
+
+	printf("%d of %zu programs failed\n", failed, sizeof(PROGRAMS) / sizeof(PROGRAMS[0]));
+	return failed ? 1 : 0;
+}
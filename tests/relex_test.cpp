@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "IncrementalLexer.h"
+
+// applies random edits to random programs and checks after every one that
+// IncrementalLexer::relex gives the same tokens and error as lexing the whole
+// edited text again
+static const char* PIECES[] = {
+	"a", "bc", "if", "else", "x1", "_y", "0", "42", "1.5", "3.", "+", "-", "*", "/", "!",
+	"(", ")", ";", "=", "==", "<", "<=", ">", ">=", "&&", "||", "&", "|",
+	" ", " ", "  ", "\n", "\t", "\r\n", "$",
+};
+
+static const size_t PIECE_COUNT = sizeof(PIECES) / sizeof(PIECES[0]);
+
+static std::string random_text(std::mt19937& rng, size_t pieces)
+{
+	std::string text;
+	for (size_t i = 0; i < pieces; i++)
+	{
+		// a stream with an error is lexed again in full, keep them rare
+		const char* piece = PIECES[rng() % PIECE_COUNT];
+		bool error = piece[0] == '$' || ((piece[0] == '&' || piece[0] == '|') && !piece[1]);
+		if (error && rng() % 64) piece = " ";
+
+		// so do numbers run together, like "1.53."
+		bool number = piece[0] >= '0' && piece[0] <= '9';
+		if (number && !text.empty() && (isdigit((unsigned char) text.back()) || text.back() == '.')) text += ' ';
+
+		text += piece;
+	}
+	return text;
+}
+
+static bool same_stream(const Chronos::IncrementalLexer& incremental, Chronos::Lexer& full)
+{
+	std::deque<Chronos::Token> a = incremental.get_tokens();
+	const std::deque<Chronos::Token>& b = full.get_tokens();
+
+	if (a.size() != b.size() || incremental.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (!Chronos::same_token(a[i], b[i])) return false;
+	}
+
+	if (incremental.has_error() != full.has_error()) return false;
+	if (!full.has_error()) return true;
+
+	Chronos::Error x = incremental.get_error(), y = full.get_error();
+	return x.type == y.type && x.span.begin == y.span.begin && x.span.length == y.span.length;
+}
+
+// applies 'edit' to 'text' and to 'incremental', false if the tokens differ from a full lex
+static bool apply(Chronos::IncrementalLexer& incremental, Chronos::StringTable& strings, std::string& text, const Chronos::TextEdit& edit, bool& has_error, Chronos::Error& error)
+{
+	text.replace(edit.offset, edit.removed, edit.inserted);
+	incremental.relex(text.c_str(), text.size(), edit);
+
+	Chronos::Lexer full(strings);
+	full.load_text(text.c_str(), text.size());
+	full.parse_tokens();
+
+	has_error = full.has_error();
+	error = full.get_error();
+	return same_stream(incremental, full);
+}
+
+int main()
+{
+	std::mt19937 rng(1234);
+	int failed = 0;
+	int edits = 0;
+
+	for (int program = 0; program < 40 && failed < 5; program++)
+	{
+		Chronos::StringTable strings;
+		Chronos::IncrementalLexer incremental(strings);
+
+		// long enough for the stream to span several chunks
+		std::string text = random_text(rng, program % 4 ? 200 : 4000);
+		incremental.load_text(text.c_str(), text.size());
+
+		for (int step = 0; step < 100 && failed < 5; step++)
+		{
+			Chronos::TextEdit edit;
+			edit.offset = text.empty() ? 0 : rng() % (text.size() + 1);
+			edit.removed = std::min<size_t>(rng() % 6, text.size() - edit.offset);
+
+			std::string inserted = random_text(rng, rng() % 3);
+			edit.inserted = inserted;
+
+			bool has_error = false;
+			Chronos::Error error;
+			bool same = apply(incremental, strings, text, edit, has_error, error);
+			edits++;
+
+			// an error makes the next relex start over, so it is blanked out again
+			// like a user would, which is an edit like any other
+			for (int fix = 0; same && has_error && fix < 4; fix++)
+			{
+				// a lone '&' or '|' is reported at the character after it
+				edit.offset = error.span.begin > 0 ? error.span.begin - 1 : 0;
+				edit.removed = std::min<size_t>(error.span.length + 1, text.size() - edit.offset);
+				inserted = " ";
+				edit.inserted = inserted;
+
+				same = apply(incremental, strings, text, edit, has_error, error);
+				edits++;
+			}
+
+			if (!same)
+			{
+				printf("program %d, edit %d (offset %zu, removed %zu, inserted \"%s\") differs from a full lex\n",
+					program, step, edit.offset, edit.removed, inserted.c_str());
+				failed++;
+			}
+		}
+	}
+
+	printf("%d of %d edits differ from a full lex\n", failed, edits);
+	return failed ? 1 : 0;
+}